@@ -6,16 +6,139 @@
 #ifndef BUFFER_MANAGER_HPP
 #define BUFFER_MANAGER_HPP
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <exception>
+#include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <type_traits>
+#include <typeinfo>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mutex_util.hpp"
+
+#ifndef CPPUDDLE_MAX_NUMBER_GPUS
+#define CPPUDDLE_MAX_NUMBER_GPUS 1
+#endif
 
 namespace recycler {
+/// Number of locations (devices) with separate buffer managers - buffers are
+/// only ever recycled for requests on the location they were allocated on
+constexpr size_t max_number_gpus = CPPUDDLE_MAX_NUMBER_GPUS;
+static_assert(max_number_gpus > 0, "CPPUDDLE_MAX_NUMBER_GPUS has to be > 0");
+
+/// Memory attributed to one callsite tag (see the attribution tag of the
+/// recycling allocators)
+struct attribution_statistics {
+  /// Bytes of the buffers currently used by the tag
+  size_t bytes_in_use{0};
+  /// Bytes of the unused buffers last used by the tag
+  size_t bytes_cached{0};
+  /// Number of buffers requested by the tag
+  size_t number_requests{0};
+  /// Number of these requests that required a new allocation
+  size_t number_creations{0};
+};
+
+/// Kind of memory an allocator provides. The recycler trims buffers of the
+/// same kind before trimming everything once an allocation fails
+enum class memory_kind { host, device };
+
+/// Thrown by the recycler if a buffer could not be allocated even after all
+/// unused buffers were deallocated. Derives from std::bad_alloc, whatever the
+/// allocator originally threw. The device allocators throw it as well if
+/// the device runs out of memory
+class out_of_memory_error : public std::bad_alloc {
+public:
+  explicit out_of_memory_error(const std::string &what_arg)
+      : message(what_arg) {}
+  const char *what() const noexcept override { return message.what(); }
+
+private:
+  /// runtime_error only for its cheap, noexcept copyable string
+  std::runtime_error message;
+};
+
+/// Size-class rounding policies of the recycling allocators. Buffers only get
+/// recycled for requests of exactly the same size - rounding the requests up
+/// to a size class makes buffers of similar sizes interchangeable. The
+/// containers never see the rounded size. exact_size is the default
+struct exact_size {
+  template <typename T> static size_t round(size_t number_elements) noexcept {
+    return number_elements;
+  }
+};
+/// Rounds up to the next power of two (at most 2x the requested memory).
+/// Sizes above the largest power of two stay as they are
+struct power_of_two_size {
+  template <typename T> static size_t round(size_t number_elements) noexcept {
+    if (number_elements > std::numeric_limits<size_t>::max() / 2 + 1) {
+      return number_elements;
+    }
+    size_t size_class = 1;
+    while (size_class < number_elements) {
+      size_class <<= 1;
+    }
+    return number_elements == 0 ? 0 : size_class;
+  }
+};
+/// Geometric size classes: Each power of two interval is split into
+/// Classes_Per_Doubling classes, thus consecutive classes differ by at most
+/// a factor of 1 + 1 / Classes_Per_Doubling
+template <size_t Classes_Per_Doubling> struct geometric_size {
+  static_assert(Classes_Per_Doubling > 0 &&
+                    (Classes_Per_Doubling & (Classes_Per_Doubling - 1)) == 0,
+                "Classes_Per_Doubling has to be a power of two");
+  template <typename T> static size_t round(size_t number_elements) noexcept {
+    size_t lower_power = 1;
+    while (lower_power <= number_elements / 2) {
+      lower_power <<= 1;
+    }
+    const size_t step = lower_power / Classes_Per_Doubling;
+    if (step <= 1 ||
+        number_elements > std::numeric_limits<size_t>::max() - (step - 1)) {
+      return number_elements;
+    }
+    return (number_elements + step - 1) / step * step;
+  }
+};
+/// Classes 1.125x apart
+using geometric_size_9_8 = geometric_size<8>;
+/// Classes 1.25x apart
+using geometric_size_5_4 = geometric_size<4>;
+/// Rounds the size in bytes up to a multiple of Page_Size. If Page_Size is
+/// no multiple of sizeof(T), the classes are the smallest multiples of
+/// Page_Size that are whole numbers of elements as well
+template <size_t Page_Size = 4096> struct page_multiple_size {
+  static_assert(Page_Size > 0, "Page_Size has to be > 0");
+  template <typename T> static size_t round(size_t number_elements) noexcept {
+    // elements per class: lcm(Page_Size, sizeof(T)) / sizeof(T)
+    constexpr size_t step = Page_Size / gcd(Page_Size, sizeof(T));
+    if (number_elements > std::numeric_limits<size_t>::max() - (step - 1)) {
+      return number_elements;
+    }
+    return (number_elements + step - 1) / step * step;
+  }
+
+private:
+  static constexpr size_t gcd(size_t a, size_t b) noexcept {
+    return b == 0 ? a : gcd(b, a % b);
+  }
+};
+
 namespace detail {
 
 namespace util {
@@ -42,44 +165,127 @@ void destroy_n(ForwardIt first, Size n) {
 }
 } // namespace util
 
+/// Allocates and deallocates buffers of the Host_Allocator on a location
+/// (device). By default the location is ignored - allocators of device memory
+/// specialize this to switch to the correct device first (see
+/// cuda_buffer_util.hpp)
+template <typename Host_Allocator> struct location_allocator_traits {
+  using value_type = typename Host_Allocator::value_type;
+  static value_type *allocate(Host_Allocator &alloc, size_t number_elements,
+                              size_t /*location_id*/) {
+    return alloc.allocate(number_elements);
+  }
+  static void deallocate(Host_Allocator &alloc, value_type *p,
+                         size_t number_elements, size_t /*location_id*/) {
+    alloc.deallocate(p, number_elements);
+  }
+};
+
+/// Classifies the allocation failures of the Host_Allocator. Only failures
+/// due to a lack of memory are worth trimming unused buffers and retrying.
+/// By default that is a std::bad_alloc of host memory - allocators of other
+/// memory kinds or reporting errors differently specialize this (see
+/// cuda_buffer_util.hpp)
+template <typename Host_Allocator> struct allocation_failure_traits {
+  static constexpr memory_kind kind = memory_kind::host;
+  static bool is_out_of_memory(const std::exception &e) noexcept {
+    return dynamic_cast<const std::bad_alloc *>(&e) != nullptr;
+  }
+};
+
 class buffer_recycler {
   // Public interface
 public:
   /// Returns and allocated buffer of the requested size - this may be a reused
-  /// buffer
+  /// buffer. Each location (device) has its own buffer manager. The buffer
+  /// gets attributed to tag (a string that outlives the recycler, e.g. a
+  /// literal - only with CPPUDDLE_HAVE_ATTRIBUTION). If number_elements is a
+  /// size class, number_requested points to the size it was rounded up from
   template <typename T, typename Host_Allocator>
-  static T *get(size_t number_elements, bool manage_content_lifetime = false) {
-    std::lock_guard<std::mutex> guard(mut);
+  static T *get(size_t number_elements, bool manage_content_lifetime = false,
+                size_t location_id = 0, const char *tag = nullptr,
+                const size_t *number_requested = nullptr) {
+    assert(location_id < max_number_gpus);
+    std::lock_guard<mutex_t> guard(mut);
     if (!recycler_instance) {
       // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
       recycler_instance.reset(new buffer_recycler());
     }
-    return buffer_manager<T, Host_Allocator>::get(number_elements,
-                                                  manage_content_lifetime);
+    T *buffer = buffer_manager<T, Host_Allocator>::get(
+        number_elements, manage_content_lifetime, location_id, tag);
+    count_fragmentation<T, Host_Allocator>(number_requested, &number_elements,
+                                           1, location_id);
+    return buffer;
   }
-  /// Marks an buffer as unused and fit for reusage
+  /// Returns number_buffers buffers (sizes given by number_elements) in
+  /// buffers, taking the lock only once for all of them. number_requested
+  /// works like for get
   template <typename T, typename Host_Allocator>
-  static void mark_unused(T *p, size_t number_elements) {
-    std::lock_guard<std::mutex> guard(mut);
+  static void get_many(const size_t *number_elements, T **buffers,
+                       size_t number_buffers,
+                       bool manage_content_lifetime = false,
+                       size_t location_id = 0, const char *tag = nullptr,
+                       const size_t *number_requested = nullptr) {
+    assert(location_id < max_number_gpus);
+    std::lock_guard<mutex_t> guard(mut);
+    if (!recycler_instance) {
+      // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+      recycler_instance.reset(new buffer_recycler());
+    }
+    buffer_manager<T, Host_Allocator>::get_many(number_elements, buffers,
+                                                number_buffers,
+                                                manage_content_lifetime,
+                                                location_id, tag);
+    count_fragmentation<T, Host_Allocator>(number_requested, number_elements,
+                                           number_buffers, location_id);
+  }
+  /// Marks number_buffers buffers as unused, taking the lock only once for all
+  /// of them
+  template <typename T, typename Host_Allocator>
+  static void release_many(T *const *buffers, const size_t *number_elements,
+                           size_t number_buffers, size_t location_id = 0) {
+    assert(location_id < max_number_gpus);
+    std::lock_guard<mutex_t> guard(mut);
     if (recycler_instance) { // if the instance was already destroyed all buffers
                              // are destroyed anyway
-      return buffer_manager<T, Host_Allocator>::mark_unused(p, number_elements);
+      for (size_t i = 0; i < number_buffers; i++) {
+        buffer_manager<T, Host_Allocator>::mark_unused(
+            buffers[i], number_elements[i], location_id);
+      }
+    }
+  }
+  /// Marks an buffer as unused and fit for reusage. location_id has to be the
+  /// one the buffer was obtained with
+  template <typename T, typename Host_Allocator>
+  static void mark_unused(T *p, size_t number_elements,
+                          size_t location_id = 0) {
+    assert(location_id < max_number_gpus);
+    std::lock_guard<mutex_t> guard(mut);
+    if (recycler_instance) { // if the instance was already destroyed all buffers
+                             // are destroyed anyway
+      return buffer_manager<T, Host_Allocator>::mark_unused(p, number_elements,
+                                                            location_id);
     }
   }
   /// Increase the reference coutner of a buffer
   template <typename T, typename Host_Allocator>
-  static void increase_usage_counter(T *p, size_t number_elements) noexcept {
-    std::lock_guard<std::mutex> guard(mut);
+  static void increase_usage_counter(T *p, size_t number_elements,
+                                     size_t location_id = 0) noexcept {
+    assert(location_id < max_number_gpus);
+    std::lock_guard<mutex_t> guard(mut);
     if (recycler_instance) { // if the instance was already destroyed all buffers
                              // are destroyed anyway
       return buffer_manager<T, Host_Allocator>::increase_usage_counter(
-          p, number_elements);
+          p, number_elements, location_id);
     }
   }
   /// Deallocated all buffers, no matter whether they are marked as used or not
   static void clean_all() {
-    std::lock_guard<std::mutex> guard(mut);
+    std::lock_guard<mutex_t> guard(mut);
     if (recycler_instance) {
+      if (!recycler_instance->profile_filename.empty()) {
+        write_allocation_profile(recycler_instance->profile_filename);
+      }
       for (const auto &clean_function :
            recycler_instance->total_cleanup_callbacks) {
         clean_function();
@@ -87,15 +293,130 @@ public:
     }
     recycler_instance.reset();
   }
-  /// Deallocated all currently unused buffer
-  static void clean_unused_buffers() {
-    std::lock_guard<std::mutex> guard(mut);
+  /// Deallocates currently unused buffers until at least bytes_to_free bytes
+  /// were freed (all of them by default). Buffers that have been unused the
+  /// longest go first, no matter which buffer manager they belong to.
+  /// Returns the freed bytes
+  static size_t clean_unused_buffers(
+      size_t bytes_to_free = std::numeric_limits<size_t>::max()) {
+    std::lock_guard<mutex_t> guard(mut);
+    const auto everything = [](const partial_cleanup_callback &) {
+      return true;
+    };
+    if (bytes_to_free == std::numeric_limits<size_t>::max()) {
+      return clean_unused_buffers_unlocked(bytes_to_free, everything);
+    }
+    return evict_unused_buffers_unlocked(bytes_to_free, everything);
+  }
+  /// Like clean_unused_buffers, but only deallocates buffers of the given
+  /// memory kind (e.g. only host memory when the host runs low)
+  static size_t clean_unused_buffers(size_t bytes_to_free, memory_kind kind) {
+    std::lock_guard<mutex_t> guard(mut);
+    return evict_unused_buffers_unlocked(
+        bytes_to_free, [kind](const partial_cleanup_callback &callback) {
+          return callback.kind == kind;
+        });
+  }
+  /// Limits the device memory of all buffers (used and unused) on location_id
+  /// to bytes (0: no limit). Lasts until clean_all
+  static void set_device_memory_budget(size_t location_id, size_t bytes) {
+    assert(location_id < max_number_gpus);
+    std::lock_guard<mutex_t> guard(mut);
+    if (!recycler_instance) {
+      // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+      recycler_instance.reset(new buffer_recycler());
+    }
+    recycler_instance->device_memory_budgets[location_id] = bytes;
+  }
+  /// Bytes of device memory allocated by the recycler on location_id
+  static size_t get_device_memory_usage(size_t location_id) {
+    assert(location_id < max_number_gpus);
+    std::lock_guard<mutex_t> guard(mut);
+    return recycler_instance
+               ? recycler_instance->device_memory_used[location_id]
+               : 0;
+  }
+  /// Returns the statistics of each attribution tag (buffers obtained without
+  /// a tag are listed as "untagged"). Always empty without
+  /// CPPUDDLE_HAVE_ATTRIBUTION
+  static std::map<std::string, attribution_statistics>
+  get_attribution_statistics() {
+    std::map<std::string, attribution_statistics> statistics;
+#ifdef CPPUDDLE_HAVE_ATTRIBUTION
+    std::lock_guard<mutex_t> guard(mut);
     if (recycler_instance) {
-      for (const auto &clean_function :
-           recycler_instance->partial_cleanup_callbacks) {
-        clean_function();
+      for (const auto &entry : recycler_instance->attribution) {
+        auto &merged =
+            statistics[entry.first != nullptr ? entry.first : "untagged"];
+        merged.bytes_in_use += entry.second.bytes_in_use;
+        merged.bytes_cached += entry.second.bytes_cached;
+        merged.number_requests += entry.second.number_requests;
+        merged.number_creations += entry.second.number_creations;
+      }
+    }
+#endif
+    return statistics;
+  }
+  /// Creates the buffer manager without requesting a buffer. With a loaded
+  /// allocation profile, this preallocates its buffers - this way that can
+  /// happen in the background while the application is starting up. The
+  /// buffers get allocated without holding mut, so concurrent requests are
+  /// not blocked by the warm up
+  template <typename T, typename Host_Allocator>
+  static void warm_up(size_t location_id = 0) {
+    assert(location_id < max_number_gpus);
+    {
+      std::lock_guard<mutex_t> guard(mut);
+      if (!recycler_instance) {
+        // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+        recycler_instance.reset(new buffer_recycler());
       }
+      buffer_manager<T, Host_Allocator>::init(location_id);
     }
+    buffer_manager<T, Host_Allocator>::preallocate_from_profile(location_id);
+  }
+  /// Loads the allocation profile in filename (if the file exists). warm_up
+  /// preallocates the buffers listed for a buffer manager. The profile of the
+  /// current run gets written to filename during clean_all. Returns whether a
+  /// profile was loaded
+  static bool enable_allocation_profile(const std::string &filename) {
+    std::lock_guard<mutex_t> guard(mut);
+    if (!recycler_instance) {
+      // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+      recycler_instance.reset(new buffer_recycler());
+    }
+    recycler_instance->profile_filename = filename;
+    recycler_instance->loaded_profile.clear();
+    std::ifstream profile_file(filename);
+    if (!profile_file) {
+      return false;
+    }
+    // Line format: <manager key> <location> <buffer size> <number of buffers>
+    std::string line;
+    while (std::getline(profile_file, line)) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      // the manager key may contain spaces (depends on the typeid names)
+      size_t split = line.size();
+      for (size_t number_fields = 0; number_fields < 2; number_fields++) {
+        split = line.find_last_of(' ', split - 1);
+        if (split == std::string::npos || split == 0) {
+          break;
+        }
+      }
+      if (split == std::string::npos || split == 0) {
+        continue; // malformed
+      }
+      std::istringstream numbers(line.substr(split + 1));
+      size_t buffer_size = 0;
+      size_t number_buffers = 0;
+      if (numbers >> buffer_size >> number_buffers) {
+        recycler_instance->loaded_profile[line.substr(0, split)].emplace_back(
+            buffer_size, number_buffers);
+      }
+    }
+    return true;
   }
 
   // Member variables and methods
@@ -105,13 +426,46 @@ private:
   /// Callbacks for buffer_manager cleanups - each callback completely destroys
   /// one buffer_manager
   std::list<std::function<void()>> total_cleanup_callbacks;
-  /// Callbacks for partial buffer_manager cleanups - each callback deallocates
-  /// all unused buffers of a manager
-  std::list<std::function<void()>> partial_cleanup_callbacks;
+  /// Partial cleanup of one buffer_manager - clean deallocates unused buffers
+  /// of the manager (oldest first) until the given number of bytes is freed
+  /// and returns the freed bytes
+  struct partial_cleanup_callback {
+    memory_kind kind;
+    size_t location_id;
+    std::function<size_t(size_t)> clean;
+    /// Release stamp of the oldest unused buffer of the manager (max if there
+    /// is none)
+    std::function<size_t()> oldest_release_stamp;
+  };
+  /// Callbacks for partial buffer_manager cleanups
+  std::list<partial_cleanup_callback> partial_cleanup_callbacks;
+  /// Callbacks writing the allocation profile of a buffer_manager
+  std::list<std::function<void(std::ostream &)>> profile_callbacks;
+  /// Global recency order of the unused buffers of all managers: Each
+  /// released buffer gets the next stamp
+  size_t release_clock{0};
+  /// Device memory budget of each location (0: no limit) and the bytes of
+  /// device memory currently allocated there
+  std::array<size_t, max_number_gpus> device_memory_budgets{};
+  std::array<size_t, max_number_gpus> device_memory_used{};
+  /// Allocation profile gets written here during clean_all (if not empty)
+  std::string profile_filename;
+  /// Profile of the last run: Buffer sizes and counts for each manager key
+  /// (manager type and location)
+  std::unordered_map<std::string, std::vector<std::pair<size_t, size_t>>>
+      loaded_profile;
+#ifdef CPPUDDLE_HAVE_ATTRIBUTION
+  /// Statistics for each attribution tag (keyed by the tag pointer - tags
+  /// with the same content get merged in get_attribution_statistics)
+  std::unordered_map<const char *, attribution_statistics> attribution;
+  static attribution_statistics &get_tag_statistics(const char *tag) {
+    return recycler_instance->attribution[tag];
+  }
+#endif
   /// One Mutex to control concurrent access - Since we do not actually ever
   /// return the singleton instance anywhere, this should hopefully suffice We
   /// want more fine-grained concurrent access eventually
-  static std::mutex mut;
+  static mutex_t mut;
   /// default, private constructor - not automatically constructed due to the
   /// deleted constructors
   buffer_recycler() = default;
@@ -123,10 +477,154 @@ private:
   }
   /// Add a callback function that gets executed upon partial (unused memory)
   /// cleanup
-  static void add_partial_cleanup_callback(const std::function<void()> &func) {
+  static void add_partial_cleanup_callback(
+      memory_kind kind, size_t location_id,
+      const std::function<size_t(size_t)> &func,
+      const std::function<size_t()> &oldest_release_stamp) {
     // This methods assumes instance is initialized since it is a private method
     // and all static public methods have guards
-    recycler_instance->partial_cleanup_callbacks.push_back(func);
+    recycler_instance->partial_cleanup_callbacks.push_back(
+        partial_cleanup_callback{kind, location_id, func,
+                                 oldest_release_stamp});
+  }
+  static size_t next_release_stamp() {
+    return recycler_instance->release_clock++;
+  }
+  /// Whether bytes more device memory fit into the budget of location_id.
+  /// Evicts unused device buffers of the location (least recently used
+  /// first) to make room if allowed to. Assumes mut is already locked
+  static bool fits_device_memory_budget(size_t location_id, size_t bytes,
+                                        bool evict) {
+    const size_t budget = recycler_instance->device_memory_budgets[location_id];
+    const auto &used = recycler_instance->device_memory_used;
+    if (budget == 0 || used[location_id] + bytes <= budget) {
+      return true;
+    }
+    if (evict && bytes <= budget) {
+      evict_unused_buffers_unlocked(
+          used[location_id] + bytes - budget,
+          [location_id](const partial_cleanup_callback &callback) {
+            return callback.kind == memory_kind::device &&
+                   callback.location_id == location_id;
+          });
+    }
+    return used[location_id] + bytes <= budget;
+  }
+  /// Counts the bytes the requests got rounded up by their size class as
+  /// internal fragmentation of the buffer manager (only with
+  /// CPPUDDLE_HAVE_COUNTERS). Without number_requested nothing was rounded.
+  /// Assumes mut is already locked
+  template <typename T, typename Host_Allocator>
+  static void count_fragmentation(const size_t *number_requested,
+                                  const size_t *number_rounded,
+                                  size_t number_buffers, size_t location_id) {
+#ifdef CPPUDDLE_HAVE_COUNTERS
+    if (number_requested == nullptr) {
+      return;
+    }
+    size_t fragmentation_bytes = 0;
+    for (size_t i = 0; i < number_buffers; i++) {
+      assert(number_rounded[i] >= number_requested[i]);
+      fragmentation_bytes +=
+          (number_rounded[i] - number_requested[i]) * sizeof(T);
+    }
+    buffer_manager<T, Host_Allocator>::add_internal_fragmentation(
+        fragmentation_bytes, location_id);
+#else
+    static_cast<void>(number_requested);
+    static_cast<void>(number_rounded);
+    static_cast<void>(number_buffers);
+    static_cast<void>(location_id);
+#endif
+  }
+  /// Deallocates the unused buffers of the managers selected by the predicate
+  /// in global release order (least recently used first) until bytes_to_free
+  /// bytes are freed. Merges the per-manager orders with a heap of the oldest
+  /// buffer of each manager. Assumes mut is already locked
+  template <typename Predicate>
+  static size_t evict_unused_buffers_unlocked(size_t bytes_to_free,
+                                              Predicate &&selected) {
+    constexpr size_t no_buffer = std::numeric_limits<size_t>::max();
+    using candidate = std::pair<size_t, const partial_cleanup_callback *>;
+    const auto newer = [](const candidate &a, const candidate &b) {
+      return a.first > b.first;
+    };
+    std::priority_queue<candidate, std::vector<candidate>, decltype(newer)>
+        oldest_buffers(newer);
+    if (!recycler_instance) {
+      return 0;
+    }
+    for (const auto &callback : recycler_instance->partial_cleanup_callbacks) {
+      if (selected(callback)) {
+        const size_t stamp = callback.oldest_release_stamp();
+        if (stamp != no_buffer) {
+          oldest_buffers.emplace(stamp, &callback);
+        }
+      }
+    }
+    size_t freed_bytes = 0;
+    while (freed_bytes < bytes_to_free && !oldest_buffers.empty()) {
+      const partial_cleanup_callback *callback = oldest_buffers.top().second;
+      oldest_buffers.pop();
+      freed_bytes += callback->clean(1); // just the oldest buffer
+      const size_t stamp = callback->oldest_release_stamp();
+      if (stamp != no_buffer) {
+        oldest_buffers.emplace(stamp, callback);
+      }
+    }
+    return freed_bytes;
+  }
+  /// Runs the partial cleanup of the managers selected by the predicate until
+  /// bytes_to_free bytes are freed. Assumes mut is already locked (e.g. within
+  /// get when an allocation failed)
+  template <typename Predicate>
+  static size_t clean_unused_buffers_unlocked(size_t bytes_to_free,
+                                              Predicate &&selected) {
+    size_t freed_bytes = 0;
+    if (recycler_instance) {
+      for (const auto &callback :
+           recycler_instance->partial_cleanup_callbacks) {
+        if (freed_bytes >= bytes_to_free) {
+          break;
+        }
+        if (selected(callback)) {
+          freed_bytes += callback.clean(bytes_to_free - freed_bytes);
+        }
+      }
+    }
+    return freed_bytes;
+  }
+  /// Add a callback function that writes the allocation profile of a manager
+  static void add_profile_callback(
+      const std::function<void(std::ostream &)> &func) {
+    recycler_instance->profile_callbacks.push_back(func);
+  }
+  /// Removes the buffers listed in the loaded profile for the manager key
+  /// from the profile and returns them - each of them gets preallocated only
+  /// once
+  static std::vector<std::pair<size_t, size_t>>
+  take_profile_entries(const std::string &manager_key) {
+    std::vector<std::pair<size_t, size_t>> entries;
+    auto it = recycler_instance->loaded_profile.find(manager_key);
+    if (it != recycler_instance->loaded_profile.end()) {
+      entries = std::move(it->second);
+      recycler_instance->loaded_profile.erase(it);
+    }
+    return entries;
+  }
+  static void write_allocation_profile(const std::string &filename) {
+    std::ofstream profile_file(filename);
+    if (!profile_file) {
+      std::cerr << "Warning: Could not write allocation profile " << filename
+                << std::endl;
+      return;
+    }
+    profile_file << "# CPPuddle allocation profile: <manager key> <location> "
+                    "<buffer size> <number of buffers>"
+                 << std::endl;
+    for (const auto &profile_function : recycler_instance->profile_callbacks) {
+      profile_function(profile_file);
+    }
   }
 
 public:
@@ -134,49 +632,170 @@ public:
 
   // Subclasses
 private:
-  /// Memory Manager subclass to handle buffers a specific type
+  /// Memory Manager subclass to handle buffers a specific type. There is one
+  /// instance per location (device) - buffers never move between locations
   template <typename T, typename Host_Allocator> class buffer_manager {
   private:
-    // Tuple content: Pointer to buffer, buffer_size, reference_counter, Flag
-    // The flag at the end controls whether to buffer content is to be reused as
-    // well
-    using buffer_entry_type = std::tuple<T *, size_t, size_t, bool>;
+    // Tuple content: Pointer to buffer, buffer_size, reference_counter, Flag,
+    // release stamp. The flag controls whether to buffer content is to be
+    // reused as well. The release stamp orders the unused buffers globally
+    using buffer_entry_type = std::tuple<T *, size_t, size_t, bool, size_t>;
+    using alloc_traits = location_allocator_traits<Host_Allocator>;
+    using failure_traits = allocation_failure_traits<Host_Allocator>;
 
   public:
-    /// Cleanup and delete this singleton
-    static void clean() { manager_instance.reset(); }
-    /// Cleanup all buffers not currently in use
-    static void clean_unused_buffers_only() {
-      if (!manager_instance) {
-        return;
+    /// Cleanup and delete the manager of this location
+    static void clean(size_t location_id) {
+      manager_instances[location_id].reset();
+    }
+    /// Cleanup buffers of this location not currently in use until at least
+    /// bytes_to_free bytes are freed. Returns the freed bytes
+    static size_t clean_unused_buffers_only(size_t location_id,
+                                            size_t bytes_to_free) {
+      auto &instance = manager_instances[location_id];
+      if (!instance) {
+        return 0;
       }
-      for (auto &buffer_tuple : manager_instance->unused_buffer_list) {
-        Host_Allocator alloc;
-        if (std::get<3>(buffer_tuple)) {
-          util::destroy_n(std::get<0>(buffer_tuple), std::get<1>(buffer_tuple));
-        }
-        alloc.deallocate(std::get<0>(buffer_tuple), std::get<1>(buffer_tuple));
+      size_t freed_bytes = 0;
+      // Released buffers get pushed to the front -> the back is the oldest
+      auto &unused_buffers = instance->unused_buffer_list;
+      while (freed_bytes < bytes_to_free && !unused_buffers.empty()) {
+        auto &buffer_tuple = unused_buffers.back();
+#ifdef CPPUDDLE_HAVE_ATTRIBUTION
+        instance->attribute_deallocation(std::get<0>(buffer_tuple),
+                                         std::get<1>(buffer_tuple));
+#endif
+        instance->deallocate_buffer(buffer_tuple);
+        freed_bytes += std::get<1>(buffer_tuple) * sizeof(T);
+        unused_buffers.pop_back();
+      }
+      return freed_bytes;
+    }
+    /// Release stamp of the buffer of this location that has been unused the
+    /// longest
+    static size_t oldest_release_stamp(size_t location_id) {
+      auto &instance = manager_instances[location_id];
+      if (!instance || instance->unused_buffer_list.empty()) {
+        return std::numeric_limits<size_t>::max();
       }
-      manager_instance->unused_buffer_list.clear();
+      return std::get<4>(instance->unused_buffer_list.back());
     }
 
-    /// Tries to recycle or create a buffer of type T and size number_elements.
-    static T *get(size_t number_of_elements, bool manage_content_lifetime) {
-      if (!manager_instance) {
-        manager_instance.reset(new buffer_manager());
-        buffer_recycler::add_total_cleanup_callback(clean);
+    /// Creates the manager of this location if it does not exist yet
+    static void init(size_t location_id) {
+      auto &instance = manager_instances[location_id];
+      if (!instance) {
+        instance.reset(new buffer_manager(location_id));
+        buffer_recycler::add_total_cleanup_callback(
+            [location_id]() { clean(location_id); });
         buffer_recycler::add_partial_cleanup_callback(
-            clean_unused_buffers_only);
+            failure_traits::kind, location_id,
+            [location_id](size_t bytes_to_free) {
+              return clean_unused_buffers_only(location_id, bytes_to_free);
+            },
+            [location_id]() { return oldest_release_stamp(location_id); });
+        buffer_recycler::add_profile_callback(
+            [location_id](std::ostream &out) {
+              write_profile(location_id, out);
+            });
+      }
+    }
+
+    /// Allocates the buffers the allocation profile lists for this location
+    /// as unused buffers. Only taking the profile entries and inserting the
+    /// buffers lock mut - the allocations themselves do not. Stops at the
+    /// first failing allocation, as the profile is only an optimization.
+    /// Device buffers have to fit into the budget of the location both
+    /// before their allocation and when they get inserted
+    static void preallocate_from_profile(size_t location_id) {
+      std::vector<size_t> buffer_sizes;
+      {
+        std::lock_guard<mutex_t> guard(mut);
+        if (!recycler_instance || !manager_instances[location_id]) {
+          return;
+        }
+        size_t bytes = 0;
+        for (const auto &entry : buffer_recycler::take_profile_entries(
+                 get_profile_key(location_id))) {
+          for (size_t i = 0; i < entry.second; i++) {
+            bytes += entry.first * sizeof(T);
+            if (failure_traits::kind == memory_kind::device &&
+                !buffer_recycler::fits_device_memory_budget(location_id,
+                                                            bytes, false)) {
+              break;
+            }
+            buffer_sizes.push_back(entry.first);
+          }
+        }
+      }
+
+      std::vector<T *> buffers;
+      buffers.reserve(buffer_sizes.size());
+      try {
+        for (const size_t number_of_elements : buffer_sizes) {
+          Host_Allocator alloc;
+          buffers.push_back(
+              alloc_traits::allocate(alloc, number_of_elements, location_id));
+        }
+      } catch (std::bad_alloc &e) {
+      } catch (std::runtime_error &e) { // e.g. cudaMalloc failures
       }
+
+      // The manager may have been cleaned up (or the budget been used up by
+      // other requests) in the meantime
+      size_t number_inserted = 0;
+      {
+        std::lock_guard<mutex_t> guard(mut);
+        auto &instance = manager_instances[location_id];
+        for (; recycler_instance && instance &&
+               number_inserted < buffers.size();
+             number_inserted++) {
+          T *buffer = buffers[number_inserted];
+          const size_t number_of_elements = buffer_sizes[number_inserted];
+          if (failure_traits::kind == memory_kind::device &&
+              !buffer_recycler::fits_device_memory_budget(
+                  location_id, number_of_elements * sizeof(T), false)) {
+            break;
+          }
+          instance->track_device_memory(number_of_elements, true);
+          instance->unused_buffer_list.push_front(
+              std::make_tuple(buffer, number_of_elements, 0, false,
+                              buffer_recycler::next_release_stamp()));
+#ifdef CPPUDDLE_HAVE_COUNTERS
+          instance->number_preallocation++;
+#endif
+#ifdef CPPUDDLE_HAVE_ATTRIBUTION
+          instance->buffer_tags[buffer] = nullptr;
+          buffer_recycler::get_tag_statistics(nullptr).bytes_cached +=
+              number_of_elements * sizeof(T);
+#endif
+        }
+      }
+      for (size_t i = number_inserted; i < buffers.size(); i++) {
+        Host_Allocator alloc;
+        alloc_traits::deallocate(alloc, buffers[i], buffer_sizes[i],
+                                 location_id);
+      }
+    }
+
+    /// Tries to recycle or create a buffer of type T and size number_elements
+    /// on the location location_id.
+    static T *get(size_t number_of_elements, bool manage_content_lifetime,
+                  size_t location_id, const char *tag) {
+#ifndef CPPUDDLE_HAVE_ATTRIBUTION
+      static_cast<void>(tag);
+#endif
+      init(location_id);
+      auto &instance = manager_instances[location_id];
 #ifdef CPPUDDLE_HAVE_COUNTERS
-      manager_instance->number_allocation++;
+      instance->number_allocation++;
 #endif
       // Check for unused buffers we can recycle:
-      for (auto iter = manager_instance->unused_buffer_list.begin();
-           iter != manager_instance->unused_buffer_list.end(); iter++) {
+      for (auto iter = instance->unused_buffer_list.begin();
+           iter != instance->unused_buffer_list.end(); iter++) {
         auto tuple = *iter;
         if (std::get<1>(tuple) == number_of_elements) {
-          manager_instance->unused_buffer_list.erase(iter);
+          instance->unused_buffer_list.erase(iter);
           std::get<2>(tuple)++; // increase usage counter to 1
 
           // handle the switch from aggressive to non aggressive reusage (or
@@ -189,60 +808,69 @@ private:
             util::destroy_n(std::get<0>(tuple), std::get<1>(tuple));
             std::get<3>(tuple) = false;
           }
-          manager_instance->buffer_map.insert({std::get<0>(tuple), tuple});
+          instance->buffer_map.insert({std::get<0>(tuple), tuple});
+          instance->count_buffer_in_use(number_of_elements);
 #ifdef CPPUDDLE_HAVE_COUNTERS
-          manager_instance->number_recycling++;
+          instance->number_recycling++;
+#endif
+#ifdef CPPUDDLE_HAVE_ATTRIBUTION
+          instance->attribute_acquisition(std::get<0>(tuple),
+                                          number_of_elements, true, tag);
 #endif
           return std::get<0>(tuple);
         }
       }
 
       // No unsued buffer found -> Create new one and return it
-      try {
-        Host_Allocator alloc;
-        T *buffer = alloc.allocate(number_of_elements);
-        manager_instance->buffer_map.insert(
-            {buffer, std::make_tuple(buffer, number_of_elements, 1,
-                                     manage_content_lifetime)});
+      T *buffer = instance->allocate_buffer(number_of_elements);
+      instance->buffer_map.insert(
+          {buffer, std::make_tuple(buffer, number_of_elements, 1,
+                                   manage_content_lifetime, 0)});
+      instance->count_buffer_in_use(number_of_elements);
 #ifdef CPPUDDLE_HAVE_COUNTERS
-        manager_instance->number_creation++;
+      instance->number_creation++;
 #endif
-        if (manage_content_lifetime) {
-          util::uninitialized_value_construct_n(buffer, number_of_elements);
-        }
-        return buffer;
-      } catch (std::bad_alloc &e) {
-        // not enough memory left! Cleanup and attempt again:
-        buffer_recycler::clean_unused_buffers();
-
-        // If there still isn't enough memory left, the caller has to handle it
-        // We've done all we can in here
-        Host_Allocator alloc;
-        T *buffer = alloc.allocate(number_of_elements);
-        manager_instance->buffer_map.insert(
-            {buffer, std::make_tuple(buffer, number_of_elements, 1,
-                                     manage_content_lifetime)});
-#ifdef CPPUDDLE_HAVE_COUNTERS
-        manager_instance->number_creation++;
-        manager_instance->number_bad_alloc++;
+#ifdef CPPUDDLE_HAVE_ATTRIBUTION
+      instance->attribute_acquisition(buffer, number_of_elements, false,
+                                      tag);
 #endif
-        if (manage_content_lifetime) {
-          util::uninitialized_value_construct_n(buffer, number_of_elements);
+      if (manage_content_lifetime) {
+        util::uninitialized_value_construct_n(buffer, number_of_elements);
+      }
+      return buffer;
+    }
+
+    /// Gets multiple buffers - if one of them cannot be created, the ones
+    /// already obtained are marked as unused again before rethrowing
+    static void get_many(const size_t *number_of_elements, T **buffers,
+                         size_t number_buffers, bool manage_content_lifetime,
+                         size_t location_id, const char *tag) {
+      size_t obtained = 0;
+      try {
+        for (; obtained < number_buffers; obtained++) {
+          buffers[obtained] = get(number_of_elements[obtained],
+                                  manage_content_lifetime, location_id, tag);
         }
-        return buffer;
+      } catch (...) {
+        for (size_t i = 0; i < obtained; i++) {
+          mark_unused(buffers[i], number_of_elements[i], location_id);
+        }
+        throw;
       }
     }
 
-    static void mark_unused(T *memory_location, size_t number_of_elements) {
+    static void mark_unused(T *memory_location, size_t number_of_elements,
+                            size_t location_id) {
       // This will never be called without an instance since all access for this
       // method comes from the buffer recycler We can forego the instance
       // existence check here
-      assert(manager_instance);
+      auto &instance = manager_instances[location_id];
+      assert(instance);
 #ifdef CPPUDDLE_HAVE_COUNTERS
-      manager_instance->number_dealloacation++;
+      instance->number_dealloacation++;
 #endif
-      auto it = manager_instance->buffer_map.find(memory_location);
-      assert(it != manager_instance->buffer_map.end());
+      auto it = instance->buffer_map.find(memory_location);
+      assert(it != instance->buffer_map.end()); // wrong location_id?
       auto &tuple = it->second;
       // sanity checks:
       assert(std::get<1>(tuple) == number_of_elements);
@@ -250,15 +878,35 @@ private:
       std::get<2>(tuple)--;          // decrease usage counter
       if (std::get<2>(tuple) == 0) { // not used anymore?
         // move to the unused_buffer list
-        manager_instance->unused_buffer_list.push_front(tuple);
-        manager_instance->buffer_map.erase(memory_location);
+        std::get<4>(tuple) = buffer_recycler::next_release_stamp();
+        instance->unused_buffer_list.push_front(tuple);
+        instance->buffer_map.erase(memory_location);
+        instance->buffers_in_use_per_size[number_of_elements]--;
+#ifdef CPPUDDLE_HAVE_ATTRIBUTION
+        instance->attribute_release(memory_location, number_of_elements);
+#endif
+      }
+    }
+
+    /// Writes the peak number of concurrently used buffers of each size to
+    /// out - regardless of how many of them got cleaned up since
+    static void write_profile(size_t location_id, std::ostream &out) {
+      auto &instance = manager_instances[location_id];
+      if (!instance) {
+        return;
+      }
+      for (const auto &entry : instance->peak_buffers_in_use_per_size) {
+        out << get_profile_key(location_id) << " " << entry.first << " "
+            << entry.second << "\n";
       }
     }
 
     static void increase_usage_counter(T *memory_location,
-                                       size_t number_of_elements) noexcept {
-      auto it = manager_instance->buffer_map.find(memory_location);
-      assert(it != manager_instance->buffer_map.end());
+                                       size_t number_of_elements,
+                                       size_t location_id) noexcept {
+      auto &instance = manager_instances[location_id];
+      auto it = instance->buffer_map.find(memory_location);
+      assert(it != instance->buffer_map.end());
       auto &tuple = it->second;
       // sanity checks:
       assert(std::get<1>(tuple) == number_of_elements);
@@ -266,50 +914,221 @@ private:
       std::get<2>(tuple)++; // increase usage counter
     }
 
+#ifdef CPPUDDLE_HAVE_COUNTERS
+    static void add_internal_fragmentation(size_t bytes, size_t location_id) {
+      auto &instance = manager_instances[location_id];
+      if (instance) {
+        instance->number_fragmentation_bytes += bytes;
+      }
+    }
+#endif
+
   private:
     /// List with all buffers still in usage
     std::unordered_map<T *, buffer_entry_type> buffer_map{};
     /// List with all buffers currently not used
     std::list<buffer_entry_type> unused_buffer_list{};
+    /// Location (device) of all buffers in this manager
+    const size_t location_id;
+    /// Number of buffers of each size currently in use and its peak (written
+    /// as the allocation profile)
+    std::unordered_map<size_t, size_t> buffers_in_use_per_size{};
+    std::map<size_t, size_t> peak_buffers_in_use_per_size{};
+    void count_buffer_in_use(size_t number_of_elements) {
+      const size_t in_use = ++buffers_in_use_per_size[number_of_elements];
+      size_t &peak = peak_buffers_in_use_per_size[number_of_elements];
+      peak = std::max(peak, in_use);
+    }
 #ifdef CPPUDDLE_HAVE_COUNTERS
     /// Performance counters
     size_t number_allocation{0}, number_dealloacation{0};
     size_t number_recycling{0}, number_creation{0}, number_bad_alloc{0};
+    size_t number_preallocation{0}, number_evicted_bytes{0};
+    size_t number_fragmentation_bytes{0};
 #endif
-    /// Singleton instance
-    static std::unique_ptr<buffer_manager<T, Host_Allocator>> manager_instance;
-    /// default, private constructor - not automatically constructed due to the
+#ifdef CPPUDDLE_HAVE_ATTRIBUTION
+    /// Attribution tag of the last user of each buffer
+    std::unordered_map<T *, const char *> buffer_tags{};
+
+    void attribute_acquisition(T *buffer, size_t number_of_elements,
+                               bool recycled, const char *tag) {
+      const size_t bytes = number_of_elements * sizeof(T);
+      if (recycled) { // the buffer no longer counts as cached memory
+        const char *&last_tag = buffer_tags[buffer];
+        buffer_recycler::get_tag_statistics(last_tag).bytes_cached -= bytes;
+        last_tag = tag;
+      } else {
+        buffer_tags[buffer] = tag;
+      }
+      auto &statistics = buffer_recycler::get_tag_statistics(tag);
+      statistics.bytes_in_use += bytes;
+      statistics.number_requests++;
+      if (!recycled) {
+        statistics.number_creations++;
+      }
+    }
+    void attribute_release(T *buffer, size_t number_of_elements) {
+      const size_t bytes = number_of_elements * sizeof(T);
+      auto &statistics =
+          buffer_recycler::get_tag_statistics(buffer_tags[buffer]);
+      statistics.bytes_in_use -= bytes;
+      statistics.bytes_cached += bytes;
+    }
+    void attribute_deallocation(T *buffer, size_t number_of_elements) {
+      auto it = buffer_tags.find(buffer);
+      assert(it != buffer_tags.end());
+      buffer_recycler::get_tag_statistics(it->second).bytes_cached -=
+          number_of_elements * sizeof(T);
+      buffer_tags.erase(it);
+    }
+#endif
+    /// Singleton instances - one per location
+    static std::array<std::unique_ptr<buffer_manager<T, Host_Allocator>>,
+                      max_number_gpus>
+        manager_instances;
+    /// private constructor - not automatically constructed due to the
     /// deleted constructors
-    buffer_manager() = default;
+    explicit buffer_manager(size_t location_id) : location_id(location_id) {}
+
+    /// Identifies this manager in the allocation profile
+    static std::string get_profile_key(size_t location_id) {
+      return std::string(typeid(Host_Allocator).name()) + "->" +
+             typeid(T).name() + " " + std::to_string(location_id);
+    }
+    /// Allocates a new buffer. If that fails due to a lack of memory, unused
+    /// buffers get evicted in stages before retrying: First the ones of this
+    /// manager, then the ones of the same memory kind (and location for
+    /// device memory), then all of them. Each stage evicts only the least
+    /// recently used buffers of its scope (enough bytes for the request) and
+    /// is repeated until its scope is empty. Throws out_of_memory_error if
+    /// even that does not suffice. Device memory has to fit into the budget of
+    /// the location first - evicting unused buffers of the location only.
+    /// Called with mut locked
+    T *allocate_buffer(size_t number_of_elements) {
+      const size_t location = location_id;
+      const auto same_kind =
+          [location](const partial_cleanup_callback &callback) {
+            return callback.kind == failure_traits::kind &&
+                   (failure_traits::kind == memory_kind::host ||
+                    callback.location_id == location);
+          };
+      const auto everything = [](const partial_cleanup_callback &) {
+        return true;
+      };
+      const size_t requested_bytes =
+          std::max<size_t>(number_of_elements * sizeof(T), 1);
+      if (failure_traits::kind == memory_kind::device &&
+          !buffer_recycler::fits_device_memory_budget(
+              location_id, number_of_elements * sizeof(T), true)) {
+        throw out_of_memory_error(
+            std::string("CPPuddle could not allocate ") +
+            std::to_string(number_of_elements * sizeof(T)) +
+            " bytes within the memory budget of device " +
+            std::to_string(location_id));
+      }
+      size_t stage = 0;
+#ifdef CPPUDDLE_HAVE_COUNTERS
+      bool failed_before = false;
+#endif
+      while (true) {
+        try {
+          Host_Allocator alloc;
+          T *buffer =
+              alloc_traits::allocate(alloc, number_of_elements, location_id);
+          track_device_memory(number_of_elements, true);
+          return buffer;
+        } catch (const std::exception &e) {
+          if (!failure_traits::is_out_of_memory(e)) {
+            throw;
+          }
+#ifdef CPPUDDLE_HAVE_COUNTERS
+          if (!failed_before) { // once per request, not per retry
+            number_bad_alloc++;
+            failed_before = true;
+          }
+#endif
+          // Retrying only makes sense if a stage actually freed something
+          size_t freed_bytes = 0;
+          while (freed_bytes == 0 && stage < 3) {
+            if (stage == 0) {
+              freed_bytes =
+                  clean_unused_buffers_only(location_id, requested_bytes);
+            } else if (stage == 1) {
+              freed_bytes = buffer_recycler::evict_unused_buffers_unlocked(
+                  requested_bytes, same_kind);
+            } else {
+              freed_bytes = buffer_recycler::evict_unused_buffers_unlocked(
+                  requested_bytes, everything);
+            }
+            if (freed_bytes == 0) {
+              stage++;
+            }
+          }
+#ifdef CPPUDDLE_HAVE_COUNTERS
+          number_evicted_bytes += freed_bytes;
+#endif
+          if (freed_bytes == 0) {
+            throw out_of_memory_error(
+                std::string("CPPuddle could not allocate ") +
+                std::to_string(number_of_elements * sizeof(T)) +
+                " bytes even after deallocating all unused buffers: " +
+                e.what());
+          }
+        }
+      }
+    }
+
+    void deallocate_buffer(buffer_entry_type &buffer_tuple) {
+      Host_Allocator alloc;
+      if (std::get<3>(buffer_tuple)) {
+        util::destroy_n(std::get<0>(buffer_tuple), std::get<1>(buffer_tuple));
+      }
+      alloc_traits::deallocate(alloc, std::get<0>(buffer_tuple),
+                               std::get<1>(buffer_tuple), location_id);
+      track_device_memory(std::get<1>(buffer_tuple), false);
+    }
+    /// Counts the device memory of allocated / deallocated buffers against
+    /// the budget of the location
+    void track_device_memory(size_t number_of_elements, bool allocated) {
+      if (failure_traits::kind != memory_kind::device || !recycler_instance) {
+        return; // no instance: destroyed during the shutdown
+      }
+      auto &used = recycler_instance->device_memory_used[location_id];
+      if (allocated) {
+        used += number_of_elements * sizeof(T);
+      } else {
+        used -= number_of_elements * sizeof(T);
+      }
+    }
 
   public:
     ~buffer_manager() {
       for (auto &buffer_tuple : unused_buffer_list) {
-        Host_Allocator alloc;
-        if (std::get<3>(buffer_tuple)) {
-          util::destroy_n(std::get<0>(buffer_tuple), std::get<1>(buffer_tuple));
-        }
-        alloc.deallocate(std::get<0>(buffer_tuple), std::get<1>(buffer_tuple));
+        deallocate_buffer(buffer_tuple);
       }
       for (auto &map_tuple : buffer_map) {
-        auto buffer_tuple = map_tuple.second;
-        Host_Allocator alloc;
-        if (std::get<3>(buffer_tuple)) {
-          util::destroy_n(std::get<0>(buffer_tuple), std::get<1>(buffer_tuple));
-        }
-        alloc.deallocate(std::get<0>(buffer_tuple), std::get<1>(buffer_tuple));
+        deallocate_buffer(map_tuple.second);
       }
 #ifdef CPPUDDLE_HAVE_COUNTERS
       // Print performance counters
       size_t number_cleaned = unused_buffer_list.size() + buffer_map.size();
       std::cout << "\nBuffer mananger destructor for buffers of type "
                 << typeid(Host_Allocator).name() << "->" << typeid(T).name()
-                << ":" << std::endl
+                << " on location " << location_id << ":" << std::endl
                 << "----------------------------------------------------"
                 << std::endl
                 << "--> Number of bad_allocs that triggered garbage "
                    "collection:       "
                 << number_bad_alloc << std::endl
+                << "--> Number of bytes evicted to handle these bad_allocs:    "
+                   "       "
+                << number_evicted_bytes << std::endl
+                << "--> Average number of bytes evicted per bad_alloc:         "
+                   "       "
+                << (number_bad_alloc > 0
+                        ? number_evicted_bytes / number_bad_alloc
+                        : 0)
+                << std::endl
                 << "--> Number of buffers that got requested from this "
                    "manager:       "
                 << number_allocation << std::endl
@@ -319,6 +1138,12 @@ private:
                 << "--> Number of times a new buffer had to be created for a "
                    "request: "
                 << number_creation << std::endl
+                << "--> Number of buffers preallocated from the allocation "
+                   "profile:   "
+                << number_preallocation << std::endl
+                << "--> Number of bytes added by size-class rounding "
+                   "(fragmentation): "
+                << number_fragmentation_bytes << std::endl
                 << "--> Number cleaned up buffers:                             "
                    "       "
                 << number_cleaned << std::endl
@@ -358,22 +1183,100 @@ public:
   buffer_recycler operator=(buffer_recycler &&other) = delete;
 };
 
+#if defined(CPPUDDLE_HAVE_HEADER_ONLY)
+// Header-only mode: The singleton state gets defined here instead of in the
+// buffer_manager library, allowing the compiler to inline all accesses
+inline std::unique_ptr<buffer_recycler> buffer_recycler::recycler_instance{};
+inline mutex_t buffer_recycler::mut{};
+#endif
+
 template <typename T, typename Host_Allocator>
-std::unique_ptr<buffer_recycler::buffer_manager<T, Host_Allocator>>
-    buffer_recycler::buffer_manager<T, Host_Allocator>::manager_instance{};
+std::array<std::unique_ptr<buffer_recycler::buffer_manager<T, Host_Allocator>>,
+           max_number_gpus>
+    buffer_recycler::buffer_manager<T, Host_Allocator>::manager_instances{};
+
+/// Rounds the requests of a batch up to their size classes. Without
+/// rounding the requested sizes are used directly, otherwise the rounded
+/// ones get stored in rounded
+template <typename T, typename Rounding_Policy>
+const size_t *round_requests(const size_t *number_elements,
+                             size_t number_buffers,
+                             std::vector<size_t> &rounded) {
+  if (std::is_same<Rounding_Policy, exact_size>::value) {
+    return number_elements;
+  }
+  rounded.resize(number_buffers);
+  for (size_t i = 0; i < number_buffers; i++) {
+    rounded[i] = Rounding_Policy::template round<T>(number_elements[i]);
+  }
+  return rounded.data();
+}
 
-template <typename T, typename Host_Allocator> struct recycle_allocator {
+/// Attribution tag of a recycling allocator: All buffers it requests get
+/// attributed to the tag (see get_attribution_statistics). Empty without
+/// CPPUDDLE_HAVE_ATTRIBUTION
+class allocator_attribution {
+public:
+#ifdef CPPUDDLE_HAVE_ATTRIBUTION
+  explicit allocator_attribution(const char *tag = nullptr) noexcept
+      : tag(tag) {}
+  const char *get_attribution_tag() const noexcept { return tag; }
+
+private:
+  const char *tag;
+#else
+  explicit allocator_attribution(const char * /*tag*/ = nullptr) noexcept {}
+  const char *get_attribution_tag() const noexcept { return nullptr; }
+#endif
+};
+
+/// Buffers are recycled within the location (device) given by location_id
+/// and attributed to the attribution tag (a string that outlives the
+/// recycler, e.g. a literal or CPPUDDLE_CALLSITE). Requests get rounded up to
+/// the size classes of the Rounding_Policy
+template <typename T, typename Host_Allocator,
+          typename Rounding_Policy = exact_size>
+struct recycle_allocator : allocator_attribution {
   using value_type = T;
+  using underlying_allocator_type = Host_Allocator;
+  using rounding_policy_type = Rounding_Policy;
+  size_t location_id{0};
   recycle_allocator() noexcept = default;
+  explicit recycle_allocator(size_t location_id,
+                             const char *attribution_tag = nullptr) noexcept
+      : allocator_attribution(attribution_tag), location_id(location_id) {}
   template <typename U>
   explicit recycle_allocator(
-      recycle_allocator<U, Host_Allocator> const &) noexcept {}
+      recycle_allocator<U, Host_Allocator, Rounding_Policy> const
+          &other) noexcept
+      : allocator_attribution(other.get_attribution_tag()),
+        location_id(other.location_id) {}
   T *allocate(std::size_t n) {
-    T *data = buffer_recycler::get<T, Host_Allocator>(n);
-    return data;
+    return buffer_recycler::get<T, Host_Allocator>(
+        Rounding_Policy::template round<T>(n), false, location_id,
+        get_attribution_tag(), &n);
   }
   void deallocate(T *p, std::size_t n) {
-    buffer_recycler::mark_unused<T, Host_Allocator>(p, n);
+    buffer_recycler::mark_unused<T, Host_Allocator>(
+        p, Rounding_Policy::template round<T>(n), location_id);
+  }
+  /// Allocates number_buffers buffers with one trip through the recycler
+  void allocate_many(const std::size_t *n, T **buffers,
+                     std::size_t number_buffers) {
+    std::vector<size_t> rounded;
+    const size_t *sizes =
+        round_requests<T, Rounding_Policy>(n, number_buffers, rounded);
+    buffer_recycler::get_many<T, Host_Allocator>(sizes, buffers, number_buffers,
+                                                 false, location_id,
+                                                 get_attribution_tag(), n);
+  }
+  /// Deallocates number_buffers buffers with one trip through the recycler
+  void deallocate_many(T *const *buffers, const std::size_t *n,
+                       std::size_t number_buffers) {
+    std::vector<size_t> rounded;
+    buffer_recycler::release_many<T, Host_Allocator>(
+        buffers, round_requests<T, Rounding_Policy>(n, number_buffers, rounded),
+        number_buffers, location_id);
   }
   template <typename... Args>
   inline void construct(T *p, Args... args) noexcept {
@@ -381,37 +1284,71 @@ template <typename T, typename Host_Allocator> struct recycle_allocator {
   }
   void destroy(T *p) { p->~T(); }
   void increase_usage_counter(T *p, size_t n) {
-    buffer_recycler::increase_usage_counter<T, Host_Allocator>(p, n);
+    buffer_recycler::increase_usage_counter<T, Host_Allocator>(
+        p, Rounding_Policy::template round<T>(n), location_id);
   }
 };
-template <typename T, typename U, typename Host_Allocator>
-constexpr bool
-operator==(recycle_allocator<T, Host_Allocator> const &,
-           recycle_allocator<U, Host_Allocator> const &) noexcept {
-  return true;
+template <typename T, typename U, typename Host_Allocator,
+          typename Rounding_Policy>
+constexpr bool operator==(
+    recycle_allocator<T, Host_Allocator, Rounding_Policy> const &lhs,
+    recycle_allocator<U, Host_Allocator, Rounding_Policy> const &rhs) noexcept {
+  return lhs.location_id == rhs.location_id;
 }
-template <typename T, typename U, typename Host_Allocator>
-constexpr bool
-operator!=(recycle_allocator<T, Host_Allocator> const &,
-           recycle_allocator<U, Host_Allocator> const &) noexcept {
-  return false;
+template <typename T, typename U, typename Host_Allocator,
+          typename Rounding_Policy>
+constexpr bool operator!=(
+    recycle_allocator<T, Host_Allocator, Rounding_Policy> const &lhs,
+    recycle_allocator<U, Host_Allocator, Rounding_Policy> const &rhs) noexcept {
+  return lhs.location_id != rhs.location_id;
 }
 
-/// Recycles not only allocations but also the contents of a buffer
-template <typename T, typename Host_Allocator>
-struct aggressive_recycle_allocator {
+/// Recycles not only allocations but also the contents of a buffer. The
+/// contents of the whole size class get constructed
+template <typename T, typename Host_Allocator,
+          typename Rounding_Policy = exact_size>
+struct aggressive_recycle_allocator : allocator_attribution {
   using value_type = T;
+  using underlying_allocator_type = Host_Allocator;
+  using rounding_policy_type = Rounding_Policy;
+  size_t location_id{0};
   aggressive_recycle_allocator() noexcept = default;
+  explicit aggressive_recycle_allocator(
+      size_t location_id, const char *attribution_tag = nullptr) noexcept
+      : allocator_attribution(attribution_tag), location_id(location_id) {}
   template <typename U>
   explicit aggressive_recycle_allocator(
-      aggressive_recycle_allocator<U, Host_Allocator> const &) noexcept {}
+      aggressive_recycle_allocator<U, Host_Allocator, Rounding_Policy> const
+          &other) noexcept
+      : allocator_attribution(other.get_attribution_tag()),
+        location_id(other.location_id) {}
   T *allocate(std::size_t n) {
-    T *data = buffer_recycler::get<T, Host_Allocator>(
-        n, true); // also initializes the buffer if it isn't reused
-    return data;
+    // also initializes the buffer if it isn't reused
+    return buffer_recycler::get<T, Host_Allocator>(
+        Rounding_Policy::template round<T>(n), true, location_id,
+        get_attribution_tag(), &n);
   }
   void deallocate(T *p, std::size_t n) {
-    buffer_recycler::mark_unused<T, Host_Allocator>(p, n);
+    buffer_recycler::mark_unused<T, Host_Allocator>(
+        p, Rounding_Policy::template round<T>(n), location_id);
+  }
+  /// Allocates number_buffers buffers with one trip through the recycler
+  void allocate_many(const std::size_t *n, T **buffers,
+                     std::size_t number_buffers) {
+    std::vector<size_t> rounded;
+    const size_t *sizes =
+        round_requests<T, Rounding_Policy>(n, number_buffers, rounded);
+    buffer_recycler::get_many<T, Host_Allocator>(sizes, buffers, number_buffers,
+                                                 true, location_id,
+                                                 get_attribution_tag(), n);
+  }
+  /// Deallocates number_buffers buffers with one trip through the recycler
+  void deallocate_many(T *const *buffers, const std::size_t *n,
+                       std::size_t number_buffers) {
+    std::vector<size_t> rounded;
+    buffer_recycler::release_many<T, Host_Allocator>(
+        buffers, round_requests<T, Rounding_Policy>(n, number_buffers, rounded),
+        number_buffers, location_id);
   }
   template <typename... Args>
   inline void construct(T *p, Args... args) noexcept {
@@ -422,20 +1359,27 @@ struct aggressive_recycle_allocator {
     // destroyed, not before
   }
   void increase_usage_counter(T *p, size_t n) {
-    buffer_recycler::increase_usage_counter<T, Host_Allocator>(p, n);
+    buffer_recycler::increase_usage_counter<T, Host_Allocator>(
+        p, Rounding_Policy::template round<T>(n), location_id);
   }
 };
-template <typename T, typename U, typename Host_Allocator>
-constexpr bool
-operator==(aggressive_recycle_allocator<T, Host_Allocator> const &,
-           aggressive_recycle_allocator<U, Host_Allocator> const &) noexcept {
-  return true;
+template <typename T, typename U, typename Host_Allocator,
+          typename Rounding_Policy>
+constexpr bool operator==(
+    aggressive_recycle_allocator<T, Host_Allocator, Rounding_Policy> const
+        &lhs,
+    aggressive_recycle_allocator<U, Host_Allocator, Rounding_Policy> const
+        &rhs) noexcept {
+  return lhs.location_id == rhs.location_id;
 }
-template <typename T, typename U, typename Host_Allocator>
-constexpr bool
-operator!=(aggressive_recycle_allocator<T, Host_Allocator> const &,
-           aggressive_recycle_allocator<U, Host_Allocator> const &) noexcept {
-  return false;
+template <typename T, typename U, typename Host_Allocator,
+          typename Rounding_Policy>
+constexpr bool operator!=(
+    aggressive_recycle_allocator<T, Host_Allocator, Rounding_Policy> const
+        &lhs,
+    aggressive_recycle_allocator<U, Host_Allocator, Rounding_Policy> const
+        &rhs) noexcept {
+  return lhs.location_id != rhs.location_id;
 }
 
 } // namespace detail
@@ -445,13 +1389,70 @@ using recycle_std = detail::recycle_allocator<T, std::allocator<T>>;
 template <typename T, std::enable_if_t<std::is_trivial<T>::value, int> = 0>
 using aggressive_recycle_std =
     detail::aggressive_recycle_allocator<T, std::allocator<T>>;
+/// Recycling std allocators with size-class rounding (e.g.
+/// recycle_std_rounded<double, geometric_size_9_8>)
+template <typename T, typename Rounding_Policy,
+          std::enable_if_t<std::is_trivial<T>::value, int> = 0>
+using recycle_std_rounded =
+    detail::recycle_allocator<T, std::allocator<T>, Rounding_Policy>;
+template <typename T, typename Rounding_Policy,
+          std::enable_if_t<std::is_trivial<T>::value, int> = 0>
+using aggressive_recycle_std_rounded =
+    detail::aggressive_recycle_allocator<T, std::allocator<T>,
+                                         Rounding_Policy>;
 
 /// Deletes all buffers (even ones still marked as used), delete the buffer
 /// managers and the recycler itself
 inline void force_cleanup() { detail::buffer_recycler::clean_all(); }
 /// Deletes all buffers currently marked as unused
 inline void cleanup() { detail::buffer_recycler::clean_unused_buffers(); }
+/// Deletes buffers currently marked as unused (the ones unused the longest
+/// first) until at least bytes_to_free bytes were freed. Returns the freed
+/// bytes (less than bytes_to_free if not enough buffers were unused)
+inline size_t trim(size_t bytes_to_free) {
+  return detail::buffer_recycler::clean_unused_buffers(bytes_to_free);
+}
+/// Like trim, but only deletes buffers of the given memory kind
+inline size_t trim(size_t bytes_to_free, memory_kind kind) {
+  return detail::buffer_recycler::clean_unused_buffers(bytes_to_free, kind);
+}
+/// Limits the device memory the recycler allocates on location_id (used and
+/// unused buffers) to bytes - 0 removes the limit. Requests exceeding it
+/// evict unused buffers of that location, never the ones of other locations,
+/// and throw out_of_memory_error if that does not suffice. Lasts until
+/// force_cleanup
+inline void set_device_memory_budget(size_t location_id, size_t bytes) {
+  detail::buffer_recycler::set_device_memory_budget(location_id, bytes);
+}
+/// Device memory the recycler allocated on location_id (used and unused)
+inline size_t get_device_memory_usage(size_t location_id) {
+  return detail::buffer_recycler::get_device_memory_usage(location_id);
+}
+/// Statistics (bytes in use, bytes cached and churn) of each attribution tag
+inline std::map<std::string, attribution_statistics>
+get_attribution_statistics() {
+  return detail::buffer_recycler::get_attribution_statistics();
+}
+
+/// Warm start: Loads the allocation profile of the last run from filename (if
+/// it exists) and writes the profile of this run to it during force_cleanup
+inline bool enable_allocation_profile(const std::string &filename) {
+  return detail::buffer_recycler::enable_allocation_profile(filename);
+}
+/// Preallocates the buffers of the recycling allocator (and its location)
+/// listed in the allocation profile. Can be called asynchronously at startup
+template <typename Allocator> void warm_up(const Allocator &alloc) {
+  detail::buffer_recycler::warm_up<
+      typename Allocator::value_type,
+      typename Allocator::underlying_allocator_type>(alloc.location_id);
+}
 
 } // end namespace recycler
 
+#define CPPUDDLE_DETAIL_STRINGIFY(x) #x
+#define CPPUDDLE_DETAIL_TO_STRING(x) CPPUDDLE_DETAIL_STRINGIFY(x)
+/// "file:line" of the place the macro is used in (as a string literal), e.g.
+/// recycler::recycle_std<double>(0, CPPUDDLE_CALLSITE) as attribution tag
+#define CPPUDDLE_CALLSITE __FILE__ ":" CPPUDDLE_DETAIL_TO_STRING(__LINE__)
+
 #endif
@@ -0,0 +1,154 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef BUNDLE_BUFFER_UTIL_HPP
+#define BUNDLE_BUFFER_UTIL_HPP
+
+#include "buffer_manager.hpp"
+
+#include <array>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+
+namespace recycler {
+
+/// Non-owning view of one typed array within a recycled_bundle
+template <typename T> struct bundle_span {
+  T *data_pointer{nullptr};
+  size_t number_of_elements{0};
+
+  T *data() const noexcept { return data_pointer; }
+  size_t size() const noexcept { return number_of_elements; }
+  T *begin() const noexcept { return data_pointer; }
+  T *end() const noexcept { return data_pointer + number_of_elements; }
+  T &operator[](size_t index) const noexcept {
+    assert(index < number_of_elements);
+    return data_pointer[index];
+  }
+};
+
+namespace detail {
+
+/**
+ * Allocates multiple related arrays (one per type in Ts) within one recycled
+ * buffer. This requires only one trip through the buffer_recycler for all
+ * arrays and keeps them close to each other in memory. Bundles with the same
+ * types and array sizes reuse each others buffers.
+ *
+ * Each array starts at a multiple of alignment bytes (relative to the start of
+ * the buffer, which gets aligned as well) - this also avoids false sharing
+ * between the arrays.
+ */
+template <typename Host_Allocator, std::size_t alignment, typename... Ts>
+class recycled_bundle {
+  static_assert(sizeof...(Ts) > 0, "recycled_bundle requires at least one "
+                                   "array type");
+  static_assert(alignment > 0 && (alignment & (alignment - 1)) == 0,
+                "recycled_bundle alignment needs to be a power of two");
+
+private:
+  using byte_allocator = typename std::allocator_traits<
+      Host_Allocator>::template rebind_alloc<unsigned char>;
+  static constexpr size_t number_arrays = sizeof...(Ts);
+  template <size_t I>
+  using element_type = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+  static constexpr size_t round_up(size_t bytes) {
+    return (bytes + alignment - 1) / alignment * alignment;
+  }
+  /// Whether each array type can start at a multiple of alignment
+  static constexpr bool alignments_fit() {
+    constexpr size_t element_alignments[] = {alignof(Ts)...};
+    for (const size_t element_alignment : element_alignments) {
+      if (alignment % element_alignment != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::array<size_t, number_arrays> number_elements{};
+  std::array<size_t, number_arrays> offsets{};
+  size_t total_bytes{0};
+  unsigned char *buffer{nullptr};
+  unsigned char *aligned_buffer{nullptr};
+
+public:
+  template <typename... Sizes>
+  explicit recycled_bundle(Sizes... array_sizes)
+      : number_elements{{static_cast<size_t>(array_sizes)...}} {
+    static_assert(sizeof...(Sizes) == number_arrays,
+                  "recycled_bundle requires one size per array type");
+    static_assert(alignments_fit(),
+                  "recycled_bundle alignment needs to be a multiple of the "
+                  "alignment of each array type");
+    constexpr std::array<size_t, number_arrays> element_sizes{
+        {sizeof(Ts)...}};
+    size_t current_offset = 0;
+    for (size_t i = 0; i < number_arrays; i++) {
+      offsets[i] = current_offset;
+      current_offset += round_up(number_elements[i] * element_sizes[i]);
+    }
+    // Reserve enough space to align the start of the buffer ourselves -
+    // this keeps the total size (and thus the recycling) independent of the
+    // alignment the underlying allocator happens to provide
+    total_bytes = current_offset + alignment - 1;
+    buffer = buffer_recycler::get<unsigned char, byte_allocator>(total_bytes);
+    const auto address = reinterpret_cast<std::uintptr_t>(buffer);
+    aligned_buffer =
+        buffer + (round_up(address) - address); // NOLINT
+  }
+  ~recycled_bundle() {
+    buffer_recycler::mark_unused<unsigned char, byte_allocator>(buffer,
+                                                                total_bytes);
+  }
+
+  /// Returns a pointer to the first element of the I-th array
+  template <size_t I> element_type<I> *data() const noexcept {
+    static_assert(I < number_arrays, "Array index out of bounds");
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return reinterpret_cast<element_type<I> *>(aligned_buffer +
+                                               std::get<I>(offsets));
+  }
+  /// Returns the number of elements of the I-th array
+  template <size_t I> size_t size() const noexcept {
+    static_assert(I < number_arrays, "Array index out of bounds");
+    return std::get<I>(number_elements);
+  }
+  /// Returns a span of the I-th array
+  template <size_t I> bundle_span<element_type<I>> get() const noexcept {
+    return bundle_span<element_type<I>>{data<I>(), size<I>()};
+  }
+  /// Total number of bytes of the underlying recycled buffer
+  size_t size_in_bytes() const noexcept { return total_bytes; }
+
+  // not yet implemented
+  recycled_bundle(recycled_bundle const &other) = delete;
+  recycled_bundle operator=(recycled_bundle const &other) = delete;
+  recycled_bundle(recycled_bundle &&other) = delete;
+  recycled_bundle operator=(recycled_bundle &&other) = delete;
+};
+
+template <typename T> struct all_trivial;
+template <> struct all_trivial<std::tuple<>> : std::true_type {};
+template <typename T, typename... Ts>
+struct all_trivial<std::tuple<T, Ts...>>
+    : std::integral_constant<bool, std::is_trivial<T>::value &&
+                                       all_trivial<std::tuple<Ts...>>::value> {
+};
+
+} // end namespace detail
+
+/// Bundle of arrays within one recycled host buffer (cache line aligned
+/// arrays)
+template <typename... Ts>
+using recycled_bundle_std = std::enable_if_t<
+    detail::all_trivial<std::tuple<Ts...>>::value,
+    detail::recycled_bundle<std::allocator<unsigned char>, 64, Ts...>>;
+
+} // end namespace recycler
+
+#endif
@@ -7,6 +7,8 @@
 #define CUDA_BUFFER_UTIL_HPP
 
 #include "buffer_manager.hpp"
+#include "bundle_buffer_util.hpp"
+#include "staging_buffer_util.hpp"
 
 #include <cuda_runtime.h>
 #include <stdexcept>
@@ -30,6 +32,9 @@ template <class T> struct cuda_pinned_allocator {
           std::string(
               "cuda_pinned_allocator failed due to cudaMallocHost failure : ") +
           std::string(cudaGetErrorString(error));
+      if (error == cudaErrorMemoryAllocation) {
+        throw out_of_memory_error(msg);
+      }
       throw std::runtime_error(msg);
     }
     return data;
@@ -69,6 +74,9 @@ template <class T> struct cuda_device_allocator {
           std::string(
               "cuda_device_allocator failed due to cudaMalloc failure : ") +
           std::string(cudaGetErrorString(error));
+      if (error == cudaErrorMemoryAllocation) {
+        throw out_of_memory_error(msg);
+      }
       throw std::runtime_error(msg);
     }
     return data;
@@ -95,6 +103,56 @@ constexpr bool operator!=(cuda_device_allocator<T> const &,
   return false;
 }
 
+/// Allocates the device buffers of the buffer manager for location
+/// location_id on the device with the same id
+template <class T> struct location_allocator_traits<cuda_device_allocator<T>> {
+  static T *allocate(cuda_device_allocator<T> &alloc, size_t number_elements,
+                     size_t location_id) {
+#if defined(CPPUDDLE_HAVE_MULTIGPU)
+    int previous_device;
+    cudaGetDevice(&previous_device);
+    cudaSetDevice(static_cast<int>(location_id));
+    T *data = nullptr;
+    try {
+      data = alloc.allocate(number_elements);
+    } catch (...) {
+      cudaSetDevice(previous_device);
+      throw;
+    }
+    cudaSetDevice(previous_device);
+    return data;
+#else
+    assert(location_id == 0);
+    return alloc.allocate(number_elements);
+#endif
+  }
+  static void deallocate(cuda_device_allocator<T> &alloc, T *p,
+                         size_t number_elements, size_t location_id) {
+#if defined(CPPUDDLE_HAVE_MULTIGPU)
+    int previous_device;
+    cudaGetDevice(&previous_device);
+    cudaSetDevice(static_cast<int>(location_id));
+    alloc.deallocate(p, number_elements);
+    cudaSetDevice(previous_device);
+#else
+    assert(location_id == 0);
+    alloc.deallocate(p, number_elements);
+#endif
+  }
+};
+
+/// The cuda allocators throw out_of_memory_error (a std::bad_alloc) for
+/// cudaErrorMemoryAllocation - all other failures are std::runtime_errors
+/// and not worth trimming unused buffers for. The pinned allocator is host
+/// memory (the default traits), device memory counts against the budget of
+/// its device
+template <class T> struct allocation_failure_traits<cuda_device_allocator<T>> {
+  static constexpr memory_kind kind = memory_kind::device;
+  static bool is_out_of_memory(const std::exception &e) noexcept {
+    return dynamic_cast<const std::bad_alloc *>(&e) != nullptr;
+  }
+};
+
 } // end namespace detail
 
 template <typename T, std::enable_if_t<std::is_trivial<T>::value, int> = 0>
@@ -104,6 +162,22 @@ template <typename T, std::enable_if_t<std::is_trivial<T>::value, int> = 0>
 using recycle_allocator_cuda_device =
     detail::recycle_allocator<T, detail::cuda_device_allocator<T>>;
 
+template <typename... Ts>
+using recycled_bundle_cuda_host = std::enable_if_t<
+    detail::all_trivial<std::tuple<Ts...>>::value,
+    detail::recycled_bundle<detail::cuda_pinned_allocator<unsigned char>, 64,
+                            Ts...>>;
+template <typename... Ts>
+using recycled_bundle_cuda_device = std::enable_if_t<
+    detail::all_trivial<std::tuple<Ts...>>::value,
+    detail::recycled_bundle<detail::cuda_device_allocator<unsigned char>, 256,
+                            Ts...>>;
+
+/// Pinned staging ring for transfers between pageable host memory and the
+/// device (see detail::staging_ring)
+using staging_ring_cuda =
+    detail::staging_ring<detail::cuda_pinned_allocator<unsigned char>>;
+
 template <typename T, std::enable_if_t<std::is_trivial<T>::value, int> = 0>
 struct cuda_device_buffer {
   size_t gpu_id{0};
@@ -124,8 +198,9 @@ struct cuda_device_buffer {
     // Allows for testing without any changes to other projects 
     assert(gpu_id == 0); 
 #endif
+    assert(gpu_id < max_number_gpus);
     device_side_buffer =
-        recycle_allocator_cuda_device<T>{}.allocate(number_of_elements);
+        recycle_allocator_cuda_device<T>{gpu_id}.allocate(number_of_elements);
   }
   ~cuda_device_buffer() {
 #if defined(CPPUDDLE_HAVE_MULTIGPU) 
@@ -137,8 +212,8 @@ struct cuda_device_buffer {
     // Allows for testing without any changes to other projects 
     assert(gpu_id == 0); 
 #endif
-    recycle_allocator_cuda_device<T>{}.deallocate(device_side_buffer,
-                                                  number_of_elements);
+    recycle_allocator_cuda_device<T>{gpu_id}.deallocate(device_side_buffer,
+                                                        number_of_elements);
   }
   // not yet implemented
   cuda_device_buffer(cuda_device_buffer const &other) = delete;
@@ -7,6 +7,8 @@
 #define CUDA_BUFFER_UTIL_HPP
 
 #include "buffer_manager.hpp"
+#include "bundle_buffer_util.hpp"
+#include "staging_buffer_util.hpp"
 
 #include <hip/hip_runtime.h>
 #include <stdexcept>
@@ -36,6 +38,9 @@ template <class T> struct hip_pinned_allocator {
           std::string(
               "hip_pinned_allocator failed due to hipMallocHost failure : ") +
           std::string(hipGetErrorString(error));
+      if (error == hipErrorOutOfMemory) {
+        throw out_of_memory_error(msg);
+      }
       throw std::runtime_error(msg);
     }
     return data;
@@ -75,6 +80,9 @@ template <class T> struct hip_device_allocator {
           std::string(
               "hip_device_allocator failed due to hipMalloc failure : ") +
           std::string(hipGetErrorString(error));
+      if (error == hipErrorOutOfMemory) {
+        throw out_of_memory_error(msg);
+      }
       throw std::runtime_error(msg);
     }
     return data;
@@ -101,6 +109,56 @@ constexpr bool operator!=(hip_device_allocator<T> const &,
   return false;
 }
 
+/// Allocates the device buffers of the buffer manager for location
+/// location_id on the device with the same id
+template <class T> struct location_allocator_traits<hip_device_allocator<T>> {
+  static T *allocate(hip_device_allocator<T> &alloc, size_t number_elements,
+                     size_t location_id) {
+#if defined(CPPUDDLE_HAVE_MULTIGPU)
+    int previous_device;
+    hipGetDevice(&previous_device);
+    hipSetDevice(static_cast<int>(location_id));
+    T *data = nullptr;
+    try {
+      data = alloc.allocate(number_elements);
+    } catch (...) {
+      hipSetDevice(previous_device);
+      throw;
+    }
+    hipSetDevice(previous_device);
+    return data;
+#else
+    assert(location_id == 0);
+    return alloc.allocate(number_elements);
+#endif
+  }
+  static void deallocate(hip_device_allocator<T> &alloc, T *p,
+                         size_t number_elements, size_t location_id) {
+#if defined(CPPUDDLE_HAVE_MULTIGPU)
+    int previous_device;
+    hipGetDevice(&previous_device);
+    hipSetDevice(static_cast<int>(location_id));
+    alloc.deallocate(p, number_elements);
+    hipSetDevice(previous_device);
+#else
+    assert(location_id == 0);
+    alloc.deallocate(p, number_elements);
+#endif
+  }
+};
+
+/// The hip allocators throw out_of_memory_error (a std::bad_alloc) for
+/// hipErrorOutOfMemory - all other failures are std::runtime_errors
+/// and not worth trimming unused buffers for. The pinned allocator is host
+/// memory (the default traits), device memory counts against the budget of
+/// its device
+template <class T> struct allocation_failure_traits<hip_device_allocator<T>> {
+  static constexpr memory_kind kind = memory_kind::device;
+  static bool is_out_of_memory(const std::exception &e) noexcept {
+    return dynamic_cast<const std::bad_alloc *>(&e) != nullptr;
+  }
+};
+
 } // end namespace detail
 
 template <typename T, std::enable_if_t<std::is_trivial<T>::value, int> = 0>
@@ -110,6 +168,22 @@ template <typename T, std::enable_if_t<std::is_trivial<T>::value, int> = 0>
 using recycle_allocator_hip_device =
     detail::recycle_allocator<T, detail::hip_device_allocator<T>>;
 
+template <typename... Ts>
+using recycled_bundle_hip_host = std::enable_if_t<
+    detail::all_trivial<std::tuple<Ts...>>::value,
+    detail::recycled_bundle<detail::hip_pinned_allocator<unsigned char>, 64,
+                            Ts...>>;
+template <typename... Ts>
+using recycled_bundle_hip_device = std::enable_if_t<
+    detail::all_trivial<std::tuple<Ts...>>::value,
+    detail::recycled_bundle<detail::hip_device_allocator<unsigned char>, 256,
+                            Ts...>>;
+
+/// Pinned staging ring for transfers between pageable host memory and the
+/// device (see detail::staging_ring)
+using staging_ring_hip =
+    detail::staging_ring<detail::hip_pinned_allocator<unsigned char>>;
+
 template <typename T, std::enable_if_t<std::is_trivial<T>::value, int> = 0>
 struct hip_device_buffer {
   size_t gpu_id{0};
@@ -123,17 +197,14 @@ struct hip_device_buffer {
   explicit hip_device_buffer(size_t number_of_elements, size_t gpu_id)
       : gpu_id(gpu_id), number_of_elements(number_of_elements), set_id(true) {
 
-    // TODO Fix Multi GPU support
-    // hipSetDevice(gpu_id);
+    // The buffer manager of location gpu_id allocates on the device gpu_id
+    assert(gpu_id < max_number_gpus);
     device_side_buffer =
-        recycle_allocator_hip_device<T>{}.allocate(number_of_elements);
+        recycle_allocator_hip_device<T>{gpu_id}.allocate(number_of_elements);
   }
   ~hip_device_buffer() {
-    // TODO Fix Multi GPU support
-    // if (set_id)
-    //   hipSetDevice(gpu_id);
-    recycle_allocator_hip_device<T>{}.deallocate(device_side_buffer,
-                                                  number_of_elements);
+    recycle_allocator_hip_device<T>{gpu_id}.deallocate(device_side_buffer,
+                                                       number_of_elements);
   }
   // not yet implemented
   hip_device_buffer(hip_device_buffer const &other) = delete;
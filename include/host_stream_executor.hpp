@@ -0,0 +1,154 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef HOST_STREAM_EXECUTOR_HPP
+#define HOST_STREAM_EXECUTOR_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace recycler {
+
+/// Futures returned by async_execute of the host_stream_executor
+struct std_future_policy {
+  template <typename T> using future_type = std::future<T>;
+  template <typename T> using promise_type = std::promise<T>;
+};
+
+namespace detail {
+
+/// Simulates one stream: Tasks get executed in submission order by one
+/// worker thread. Each task gets delayed by the given latency (to simulate
+/// launch overheads / kernel runtimes).
+class host_stream_worker {
+public:
+  explicit host_stream_worker(std::chrono::microseconds latency)
+      : latency(latency), worker([this]() { run(); }) {}
+  ~host_stream_worker() {
+    {
+      std::lock_guard<std::mutex> guard(mut);
+      stop = true;
+    }
+    task_available.notify_one();
+    worker.join(); // finishes all remaining tasks first
+  }
+  void enqueue(std::function<void()> &&task) {
+    {
+      std::lock_guard<std::mutex> guard(mut);
+      tasks.push(std::move(task));
+    }
+    task_available.notify_one();
+  }
+
+  host_stream_worker(const host_stream_worker &other) = delete;
+  host_stream_worker &operator=(const host_stream_worker &other) = delete;
+  host_stream_worker(host_stream_worker &&other) = delete;
+  host_stream_worker &operator=(host_stream_worker &&other) = delete;
+
+private:
+  void run() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mut);
+        task_available.wait(lock, [this]() { return stop || !tasks.empty(); });
+        if (tasks.empty()) {
+          return; // stopped and nothing left to do
+        }
+        task = std::move(tasks.front());
+        tasks.pop();
+      }
+      if (latency.count() > 0) {
+        std::this_thread::sleep_for(latency);
+      }
+      task();
+    }
+  }
+
+  std::mutex mut;
+  std::condition_variable task_available;
+  std::queue<std::function<void()>> tasks;
+  bool stop{false};
+  const std::chrono::microseconds latency;
+  std::thread worker; // last member: starts after everything else exists
+};
+
+template <typename Promise, typename F>
+void fulfill_promise(Promise &promise, F &f, std::true_type /*void*/) {
+  f();
+  promise.set_value();
+}
+template <typename Promise, typename F>
+void fulfill_promise(Promise &promise, F &f, std::false_type /*void*/) {
+  promise.set_value(f());
+}
+
+} // end namespace detail
+
+/**
+ * Interface for the stream pools that executes everything on the host -
+ * allows to build, test and benchmark the stream management without a GPU.
+ * Each executor owns one in-order worker thread ("stream"). Copies of an
+ * executor share the same worker, just like copies of a cuda_executor share
+ * the same stream.
+ *
+ * Future_Policy defines the future type returned by async_execute
+ * (std_future_policy by default, hpx_future_policy in hpx_stream_util.hpp).
+ */
+template <typename Future_Policy = std_future_policy>
+class host_stream_executor {
+public:
+  explicit host_stream_executor(
+      size_t gpu_id = 0,
+      std::chrono::microseconds latency = std::chrono::microseconds{0})
+      : stream(std::make_shared<detail::host_stream_worker>(latency)),
+        gpu_id(gpu_id) {}
+
+  /// Enqueues f(ts...) without a way to wait for it
+  template <typename F, typename... Ts> void post(F &&f, Ts &&... ts) {
+    stream->enqueue(std::bind(std::forward<F>(f), std::forward<Ts>(ts)...));
+  }
+
+  /// Enqueues f(ts...) and returns a future of its result. The future gets
+  /// ready once f and all previously enqueued tasks are done.
+  template <typename F, typename... Ts>
+  auto async_execute(F &&f, Ts &&... ts) {
+    auto task = std::bind(std::forward<F>(f), std::forward<Ts>(ts)...);
+    using result_type = decltype(task());
+    using promise_type =
+        typename Future_Policy::template promise_type<result_type>;
+    // std::function requires copyable tasks
+    auto promise = std::make_shared<promise_type>();
+    auto future = promise->get_future();
+    stream->enqueue([promise, task]() mutable {
+      try {
+        detail::fulfill_promise(*promise, task,
+                                std::is_void<result_type>{});
+      } catch (...) {
+        promise->set_exception(std::current_exception());
+      }
+    });
+    return future;
+  }
+
+  size_t get_gpu_id() const noexcept { return gpu_id; }
+
+private:
+  std::shared_ptr<detail::host_stream_worker> stream;
+  size_t gpu_id;
+};
+
+} // end namespace recycler
+
+#endif
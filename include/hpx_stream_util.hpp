@@ -0,0 +1,232 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef HPX_STREAM_UTIL_HPP
+#define HPX_STREAM_UTIL_HPP
+
+#include <hpx/include/lcos.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <utility>
+
+#include "pipeline_util.hpp"
+#include "stream_manager.hpp"
+
+namespace recycler {
+/// Lets the host_stream_executor return HPX futures
+struct hpx_future_policy {
+  template <typename T> using future_type = hpx::future<T>;
+  template <typename T> using promise_type = hpx::lcos::local::promise<T>;
+};
+
+namespace detail {
+/// Lets launch_chunked_pipeline return an HPX future for HPX interfaces
+template <typename T> struct pipeline_future_traits<hpx::future<T>> {
+  template <typename State>
+  static hpx::future<void> when_all(std::vector<hpx::future<T>> &&futures,
+                                    std::shared_ptr<State> state) {
+    return hpx::when_all(std::move(futures))
+        .then([state](hpx::future<std::vector<hpx::future<T>>> &&all) mutable {
+          auto results = all.get();
+          for (auto &fut : results) {
+            fut.get();
+          }
+          state.reset(); // release before becoming ready
+        });
+  }
+};
+} // end namespace detail
+} // end namespace recycler
+
+/// Interface of a stream pool acquired with get_interface_async. In contrast
+/// to the stream_interface the handle is movable (it has to be moved out of
+/// the future) and releases the interface when it gets destroyed.
+template <class Interface, class Pool> class stream_pool_handle {
+public:
+  stream_pool_handle(Interface &interface, size_t interface_index,
+                     size_t weight) noexcept
+      : interface(&interface), interface_index(interface_index),
+        weight(weight) {}
+  stream_pool_handle(stream_pool_handle &&other) noexcept
+      : interface(other.interface), interface_index(other.interface_index),
+        weight(other.weight) {
+    other.interface = nullptr;
+  }
+  stream_pool_handle &operator=(stream_pool_handle &&other) noexcept {
+    if (this != &other) {
+      release();
+      interface = other.interface;
+      interface_index = other.interface_index;
+      weight = other.weight;
+      other.interface = nullptr;
+    }
+    return *this;
+  }
+  stream_pool_handle(const stream_pool_handle &other) = delete;
+  stream_pool_handle &operator=(const stream_pool_handle &other) = delete;
+  ~stream_pool_handle() { release(); }
+
+  template <typename F, typename... Ts>
+  inline decltype(auto) post(F &&f, Ts &&... ts) {
+    return interface->post(std::forward<F>(f), std::forward<Ts>(ts)...);
+  }
+
+  template <typename F, typename... Ts>
+  inline decltype(auto) async_execute(F &&f, Ts &&... ts) {
+    return interface->async_execute(std::forward<F>(f),
+                                    std::forward<Ts>(ts)...);
+  }
+
+  inline size_t get_gpu_id() noexcept { return interface->get_gpu_id(); }
+  inline size_t get_index() const noexcept { return interface_index; }
+
+  // allow implict conversion
+  operator Interface &() { // NOLINT
+    return *interface;
+  }
+
+  /// Releases the interface before the handle gets destroyed
+  void release() noexcept {
+    if (interface) {
+      stream_pool::release_interface<Interface, Pool>(interface_index, weight);
+      interface = nullptr;
+    }
+  }
+
+private:
+  Interface *interface;
+  size_t interface_index;
+  size_t weight;
+};
+
+/// Returns a future that becomes ready once an interface with a load below
+/// load_limit is available. Waiting requests are served in FIFO order by the
+/// releases of other interfaces, so producers get throttled by the actual
+/// capacity of the pool instead of polling interface_available.
+template <class Interface, class Pool>
+hpx::future<stream_pool_handle<Interface, Pool>>
+get_interface_async(size_t load_limit, size_t weight = 1) {
+  using handle_type = stream_pool_handle<Interface, Pool>;
+  // std::function requires a copyable callback
+  auto promise = std::make_shared<hpx::lcos::local::promise<handle_type>>();
+  auto future = promise->get_future();
+  stream_pool::get_interface_when_available<Interface, Pool>(
+      load_limit,
+      [promise, weight](Interface &interface, size_t index) {
+        // The handle releases the interface should this throw
+        try {
+          promise->set_value(handle_type(interface, index, weight));
+        } catch (...) {
+          promise->set_exception(std::current_exception());
+        }
+      },
+      weight);
+  return future;
+}
+
+/// Number of tasks and their accumulated latencies (from dispatch until the
+/// result is ready) per side of a hybrid_dispatcher
+struct hybrid_dispatcher_statistics {
+  size_t device_tasks{0};
+  size_t host_tasks{0};
+  size_t device_latency_us{0};
+  size_t host_latency_us{0};
+};
+
+/// Runs tasks either on an interface of the stream pool or on the host,
+/// depending on the load of the pool. Uses hysteresis: Tasks get offloaded
+/// until the current load reaches high_load_threshold, afterwards they run on
+/// the host until the load dropped to low_load_threshold again. This avoids
+/// flipping between both sides with every task. The returned futures share
+/// the state of the dispatcher - it may get destroyed before they are ready.
+template <class Interface, class Pool> class hybrid_dispatcher {
+public:
+  hybrid_dispatcher(size_t high_load_threshold, size_t low_load_threshold)
+      : state(std::make_shared<dispatcher_state>(high_load_threshold,
+                                                 low_load_threshold)) {
+    assert(low_load_threshold < high_load_threshold);
+  }
+
+  /// device_f(Interface &) has to return an hpx::future<R>, host_f() has to
+  /// return R. Returns a future of the result of whichever side got used.
+  /// weight: expected cost of the task on the interface (see
+  /// stream_interface)
+  template <typename Device_F, typename Host_F>
+  auto dispatch(Device_F &&device_f, Host_F &&host_f, size_t weight = 1) {
+    using result_type = decltype(host_f());
+    const auto begin = std::chrono::high_resolution_clock::now();
+    auto shared_state = state;
+    if (state->use_device()) {
+      auto interface = stream_pool::get_interface<Interface, Pool>(weight);
+      auto handle = std::make_shared<stream_pool_handle<Interface, Pool>>(
+          std::get<0>(interface), std::get<1>(interface), weight);
+      hpx::future<result_type> fut =
+          std::forward<Device_F>(device_f)(std::get<0>(interface));
+      return fut.then(
+          [shared_state, handle, begin](hpx::future<result_type> &&f) {
+            handle->release(); // as soon as the task is done
+            record(shared_state->device_tasks,
+                   shared_state->device_latency_us, begin);
+            return f.get();
+          });
+    }
+    return hpx::async(std::forward<Host_F>(host_f))
+        .then([shared_state, begin](hpx::future<result_type> &&f) {
+          record(shared_state->host_tasks, shared_state->host_latency_us,
+                 begin);
+          return f.get();
+        });
+  }
+
+  hybrid_dispatcher_statistics get_statistics() const noexcept {
+    hybrid_dispatcher_statistics statistics;
+    statistics.device_tasks = state->device_tasks;
+    statistics.host_tasks = state->host_tasks;
+    statistics.device_latency_us = state->device_latency_us;
+    statistics.host_latency_us = state->host_latency_us;
+    return statistics;
+  }
+
+private:
+  /// Thresholds and counters - kept alive by the pending tasks
+  struct dispatcher_state {
+    dispatcher_state(size_t high_load_threshold, size_t low_load_threshold)
+        : high_load_threshold(high_load_threshold),
+          low_load_threshold(low_load_threshold) {}
+    bool use_device() noexcept {
+      const size_t load = stream_pool::get_current_load<Interface, Pool>();
+      if (offloading && load >= high_load_threshold) {
+        offloading = false;
+      } else if (!offloading && load <= low_load_threshold) {
+        offloading = true;
+      }
+      return offloading;
+    }
+
+    const size_t high_load_threshold;
+    const size_t low_load_threshold;
+    std::atomic<bool> offloading{true};
+    std::atomic<size_t> device_tasks{0};
+    std::atomic<size_t> host_tasks{0};
+    std::atomic<size_t> device_latency_us{0};
+    std::atomic<size_t> host_latency_us{0};
+  };
+  static void
+  record(std::atomic<size_t> &tasks, std::atomic<size_t> &latency,
+         std::chrono::high_resolution_clock::time_point begin) noexcept {
+    const auto end = std::chrono::high_resolution_clock::now();
+    tasks++;
+    latency += std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                     begin)
+                   .count();
+  }
+
+  std::shared_ptr<dispatcher_state> state;
+};
+
+#endif
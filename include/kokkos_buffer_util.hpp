@@ -7,6 +7,14 @@
 #define KOKKOS_BUFFER_UTIL_HPP
 #include <Kokkos_Core.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <type_traits>
+
 namespace recycler {
 
 template <typename kokkos_type, typename alloc_type, typename element_type>
@@ -64,6 +72,129 @@ public:
 template <class kokkos_type, class alloc_type, class element_type>
 alloc_type recycled_view<kokkos_type, alloc_type, element_type>::allocator;
 
+/// Creates an unmanaged view of type kokkos_type into the I-th array of a
+/// recycled_bundle (see bundle_buffer_util.hpp). The bundle needs to outlive
+/// the view.
+template <typename kokkos_type, size_t I, typename bundle_type,
+          class... Args>
+kokkos_type make_bundle_view(const bundle_type &bundle, Args... args) {
+  using element_type =
+      std::remove_pointer_t<decltype(bundle.template data<I>())>;
+  assert(kokkos_type::required_allocation_size(args...) <=
+         bundle.template size<I>() * sizeof(element_type));
+  return kokkos_type(bundle.template data<I>(), args...);
+}
+
+namespace detail {
+
+/// Data cache sizes (in bytes) of the first CPU core
+struct cache_sizes {
+  size_t l1_data;
+  size_t l2;
+};
+
+/// Reads the size of the data/unified cache of the given level from sysfs.
+/// Returns fallback if the information is not available (non-Linux systems)
+inline size_t read_cache_size(const int level, const size_t fallback) {
+  for (int index = 0;; index++) {
+    const std::string cache_dir =
+        "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) +
+        "/";
+    std::ifstream level_file(cache_dir + "level");
+    if (!level_file) {
+      return fallback; // no more cache entries
+    }
+    int cache_level = 0;
+    std::string cache_type{};
+    std::string cache_size{};
+    level_file >> cache_level;
+    std::ifstream(cache_dir + "type") >> cache_type;
+    std::ifstream(cache_dir + "size") >> cache_size;
+    if (cache_level != level || cache_type == "Instruction" ||
+        cache_size.empty()) {
+      continue;
+    }
+    // sysfs reports sizes like 48K, 2048K or 32M
+    size_t size = std::stoul(cache_size);
+    switch (cache_size.back()) {
+    case 'K':
+      size *= 1024;
+      break;
+    case 'M':
+      size *= 1024 * 1024;
+      break;
+    case 'G':
+      size *= 1024 * 1024 * 1024;
+      break;
+    default:
+      break;
+    }
+    return size > 0 ? size : fallback;
+  }
+}
+
+/// Detects the cache sizes once and returns the cached values afterwards
+inline cache_sizes get_cache_sizes() {
+  static const cache_sizes sizes{read_cache_size(1, 32 * 1024),
+                                 read_cache_size(2, 1024 * 1024)};
+  return sizes;
+}
+
+/**
+ * Computes tile sizes for iterating view_to_iterate on a host execution space.
+ * The contiguous dimension (depending on the layout of the view) gets tiled
+ * such that one row of a tile fits into the L1 data cache, the remaining
+ * dimensions get tiled such that the whole tile uses at most half of the L2
+ * cache (leaving room for other views and halos accessed by the kernel).
+ * Positive entries in tile_override are used as they are.
+ */
+template <typename ViewType>
+Kokkos::Array<int64_t, ViewType::ViewTraits::rank>
+get_cache_aware_tiling(const ViewType &view_to_iterate,
+                       const Kokkos::Array<int64_t, ViewType::ViewTraits::rank>
+                           &tile_override) {
+  constexpr auto rank = ViewType::ViewTraits::rank;
+  constexpr bool layout_left =
+      std::is_same<typename ViewType::array_layout, Kokkos::LayoutLeft>::value;
+  const cache_sizes caches = get_cache_sizes();
+  const size_t element_size = sizeof(typename ViewType::value_type);
+
+  // Sort dimensions from the contiguous one to the one with the largest stride
+  Kokkos::Array<int, rank> dimension_order;
+  for (int i = 0; i < static_cast<int>(rank); ++i) {
+    dimension_order[i] = layout_left ? i : static_cast<int>(rank) - 1 - i;
+  }
+
+  Kokkos::Array<int64_t, rank> tiling;
+  size_t remaining_elements =
+      std::max<size_t>(caches.l2 / (2 * element_size), 1);
+  size_t remaining_dimensions = rank;
+  for (int i = 0; i < static_cast<int>(rank); ++i) {
+    const int dim = dimension_order[i];
+    const int64_t extent =
+        std::max<int64_t>(static_cast<int64_t>(view_to_iterate.extent(dim)), 1);
+    if (tile_override[dim] > 0) {
+      tiling[dim] = tile_override[dim];
+    } else if (i == 0) {
+      // contiguous dimension: one row should stay within L1
+      const int64_t l1_elements = std::max<int64_t>(
+          static_cast<int64_t>(caches.l1_data / element_size), 1);
+      tiling[dim] = std::min(extent, l1_elements);
+    } else {
+      // distribute the remaining budget evenly among the other dimensions
+      const auto even_share = static_cast<int64_t>(std::pow(
+          static_cast<double>(remaining_elements), 1.0 / remaining_dimensions));
+      tiling[dim] = std::min(extent, std::max<int64_t>(even_share, 1));
+    }
+    remaining_elements =
+        std::max<size_t>(remaining_elements / tiling[dim], 1);
+    remaining_dimensions--;
+  }
+  return tiling;
+}
+
+} // end namespace detail
+
 } // end namespace recycler
 
 /**
@@ -93,4 +224,40 @@ auto get_iteration_policy(const Executor &executor,
   // extents);
 }
 
+/**
+ * get an MDRangePolicy suitable for iterating the views with tile sizes fitting
+ * the CPU caches (for host execution spaces)
+ *
+ * @param executor          a kokkos ExecutionSpace, e.g.
+ * hpx::kokkos::make_execution_space<Kokkos::HPX>()
+ * @param view_to_iterate   the view that needs to be iterated
+ * @param tile_override     tile size per dimension - dimensions with a tile
+ * size of zero get tiled automatically based on the view layout, the element
+ * size and the cache sizes of the CPU. For non-host execution spaces the Kokkos
+ * default is used for these dimensions instead.
+ */
+template <typename Executor, typename ViewType>
+auto get_iteration_policy(
+    const Executor &executor, const ViewType &view_to_iterate,
+    const Kokkos::Array<int64_t, ViewType::ViewTraits::rank> &tile_override) {
+  constexpr auto rank = ViewType::ViewTraits::rank;
+  const Kokkos::Array<int64_t, rank> zeros{};
+  Kokkos::Array<int64_t, rank> extents;
+  for (int i = 0; i < rank; ++i) {
+    extents[i] = view_to_iterate.extent(i);
+  }
+  // Device execution spaces have their own constraints on the tile sizes
+  // (threads per block) - only tile automatically on the host
+  const Kokkos::Array<int64_t, rank> tiling =
+      Kokkos::SpaceAccessibility<Executor, Kokkos::HostSpace>::accessible
+          ? recycler::detail::get_cache_aware_tiling(view_to_iterate,
+                                                     tile_override)
+          : tile_override;
+
+  return Kokkos::Experimental::require(
+      Kokkos::MDRangePolicy<Executor, Kokkos::Rank<rank>>(executor, zeros,
+                                                          extents, tiling),
+      Kokkos::Experimental::WorkItemProperty::HintLightWeight);
+}
+
 #endif
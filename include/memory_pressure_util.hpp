@@ -0,0 +1,224 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEMORY_PRESSURE_UTIL_HPP
+#define MEMORY_PRESSURE_UTIL_HPP
+
+#include "buffer_manager.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace recycler {
+
+/// Memory used by the process (or node) and the limit it has to stay below
+struct memory_usage {
+  size_t bytes_used{0};
+  size_t bytes_limit{0};
+};
+
+/// Data source of the memory_pressure_watcher. Fills in the current usage and
+/// returns false if it is not available (e.g. missing files). Tests inject
+/// their own sources to simulate pressure
+using memory_usage_source = std::function<bool(memory_usage &)>;
+
+namespace detail {
+/// Reads a single number from a file such as memory.current. Fails for
+/// anything else, e.g. the "max" in memory.max of an unlimited cgroup
+inline bool read_number_file(const std::string &filename, size_t &value) {
+  std::ifstream file(filename);
+  return static_cast<bool>(file >> value);
+}
+} // namespace detail
+
+/// Usage and limit of the cgroup v2 in cgroup_directory (memory.current and
+/// memory.max). Unavailable if the cgroup has no memory limit
+inline memory_usage_source
+cgroup_directory_memory_source(const std::string &cgroup_directory) {
+  return [cgroup_directory](memory_usage &usage) {
+    return detail::read_number_file(cgroup_directory + "/memory.max",
+                                    usage.bytes_limit) &&
+           detail::read_number_file(cgroup_directory + "/memory.current",
+                                    usage.bytes_used);
+  };
+}
+
+/// Usage and limit of the cgroup v2 of this process: Its path below
+/// cgroup_root is the "0::<path>" line of proc_cgroup_file. Unavailable
+/// without cgroup v2 or if the cgroup has no memory limit
+inline memory_usage_source
+cgroup_memory_source(const std::string &cgroup_root = "/sys/fs/cgroup",
+                     const std::string &proc_cgroup_file =
+                         "/proc/self/cgroup") {
+  return [cgroup_root, proc_cgroup_file](memory_usage &usage) {
+    std::ifstream proc_cgroup(proc_cgroup_file);
+    std::string line;
+    while (std::getline(proc_cgroup, line)) {
+      if (line.compare(0, 3, "0::") == 0) {
+        const std::string path = line.substr(3);
+        return cgroup_directory_memory_source(
+            path == "/" ? cgroup_root : cgroup_root + path)(usage);
+      }
+    }
+    return false;
+  };
+}
+
+/// Usage of the node according to /proc/meminfo: MemTotal is the limit,
+/// everything but MemAvailable counts as used
+inline memory_usage_source
+meminfo_memory_source(const std::string &meminfo_file = "/proc/meminfo") {
+  return [meminfo_file](memory_usage &usage) {
+    std::ifstream meminfo(meminfo_file);
+    size_t total_kb = 0;
+    size_t available_kb = 0;
+    bool found_total = false;
+    bool found_available = false;
+    std::string line;
+    while (std::getline(meminfo, line)) {
+      std::istringstream fields(line);
+      std::string key;
+      size_t value = 0;
+      if (!(fields >> key >> value)) {
+        continue;
+      }
+      if (key == "MemTotal:") {
+        total_kb = value;
+        found_total = true;
+      } else if (key == "MemAvailable:") {
+        available_kb = value;
+        found_available = true;
+      }
+    }
+    if (!found_total || !found_available || available_kb > total_kb) {
+      return false;
+    }
+    usage.bytes_limit = total_kb * 1024;
+    usage.bytes_used = (total_kb - available_kb) * 1024;
+    return true;
+  };
+}
+
+/// The cgroup v2 limit if there is one, the node memory otherwise
+inline memory_usage_source default_memory_source() {
+  auto cgroup_source = cgroup_memory_source();
+  auto meminfo_source = meminfo_memory_source();
+  return [cgroup_source, meminfo_source](memory_usage &usage) {
+    return cgroup_source(usage) || meminfo_source(usage);
+  };
+}
+
+/// Thresholds of the memory_pressure_watcher as fractions of the limit
+struct memory_pressure_config {
+  /// Trimming starts once the usage exceeds this fraction of the limit...
+  double high_watermark{0.9};
+  /// ... and tries to free enough unused buffers to get down to this one
+  double low_watermark{0.8};
+  /// Time between two checks of the watcher thread
+  std::chrono::milliseconds poll_interval{100};
+};
+
+/// Trims unused host buffers of the recycler before the application runs out
+/// of memory (instead of waiting for a std::bad_alloc). Device buffers stay -
+/// freeing them would not relieve the host memory. check() polls the data
+/// source once - start() does so periodically on a background thread until
+/// stop() or the destruction of the watcher. Requires a locking policy other
+/// than CPPUDDLE_HAVE_NO_LOCKING as the thread accesses the recycler (the HPX
+/// policies support such plain threads, see mutex_util.hpp)
+class memory_pressure_watcher {
+public:
+  explicit memory_pressure_watcher(
+      memory_usage_source source = default_memory_source(),
+      memory_pressure_config config = memory_pressure_config{})
+      : source(std::move(source)), config(config) {
+    assert(config.low_watermark <= config.high_watermark);
+  }
+  ~memory_pressure_watcher() { stop(); }
+
+  /// Trims unused host buffers if the usage is above the high watermark.
+  /// Returns the freed bytes
+  size_t check() {
+    memory_usage usage;
+    if (!source(usage) || usage.bytes_limit == 0) {
+      return 0;
+    }
+    const auto limit = static_cast<double>(usage.bytes_limit);
+    const auto used = static_cast<double>(usage.bytes_used);
+    if (used <= config.high_watermark * limit) {
+      return 0;
+    }
+    const auto target = static_cast<size_t>(config.low_watermark * limit);
+    const size_t freed_bytes =
+        trim(usage.bytes_used - target, memory_kind::host);
+    number_trims++;
+    bytes_trimmed += freed_bytes;
+    return freed_bytes;
+  }
+
+  void start() {
+    std::lock_guard<std::mutex> guard(thread_mut);
+    if (watcher_thread.joinable()) {
+      return;
+    }
+    stop_requested = false;
+    watcher_thread = std::thread([this]() {
+      std::unique_lock<std::mutex> lock(thread_mut);
+      while (!stop_requested) {
+        lock.unlock();
+        check();
+        lock.lock();
+        stop_condition.wait_for(lock, config.poll_interval,
+                                [this]() { return stop_requested; });
+      }
+    });
+  }
+  void stop() {
+    std::thread finished_thread;
+    {
+      std::lock_guard<std::mutex> guard(thread_mut);
+      stop_requested = true;
+      finished_thread = std::move(watcher_thread);
+    }
+    stop_condition.notify_all();
+    if (finished_thread.joinable()) {
+      finished_thread.join();
+    }
+  }
+
+  /// Number of checks that found the usage above the high watermark
+  size_t get_number_trims() const { return number_trims; }
+  /// Bytes freed by all trims so far
+  size_t get_bytes_trimmed() const { return bytes_trimmed; }
+
+private:
+  memory_usage_source source;
+  const memory_pressure_config config;
+  std::atomic<size_t> number_trims{0};
+  std::atomic<size_t> bytes_trimmed{0};
+
+  std::thread watcher_thread;
+  std::mutex thread_mut;
+  std::condition_variable stop_condition;
+  bool stop_requested{false};
+
+public:
+  memory_pressure_watcher(const memory_pressure_watcher &other) = delete;
+  memory_pressure_watcher &
+  operator=(const memory_pressure_watcher &other) = delete;
+  memory_pressure_watcher(memory_pressure_watcher &&other) = delete;
+  memory_pressure_watcher &operator=(memory_pressure_watcher &&other) = delete;
+};
+
+} // end namespace recycler
+
+#endif
@@ -0,0 +1,113 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MUTEX_UTIL_HPP
+#define MUTEX_UTIL_HPP
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#if defined(CPPUDDLE_HAVE_HPX_YIELD_SPINLOCK) ||                               \
+    defined(CPPUDDLE_HAVE_HPX_YIELD)
+#include <hpx/include/threads.hpp>
+#endif
+
+#if defined(CPPUDDLE_HAVE_HEADER_ONLY) && __cplusplus < 201703L
+#error "CPPUDDLE_HAVE_HEADER_ONLY requires C++17 (inline variables)!"
+#endif
+
+#if (defined(CPPUDDLE_HAVE_NO_LOCKING) + defined(CPPUDDLE_HAVE_SPINLOCK) +     \
+     defined(CPPUDDLE_HAVE_HPX_YIELD_SPINLOCK) +                               \
+     defined(CPPUDDLE_HAVE_HPX_YIELD)) > 1
+#error "More than one locking policy selected!"
+#endif
+
+namespace recycler {
+namespace detail {
+
+/// Mutex that does nothing - only for single-threaded applications
+struct no_mutex {
+  void lock() noexcept {}
+  bool try_lock() noexcept { return true; }
+  void unlock() noexcept {}
+};
+
+/// Lets the OS thread wait for a lock
+struct os_thread_yield {
+  static void yield() noexcept { std::this_thread::yield(); }
+};
+
+/// Spinlock for the short critical sections of the recycler and the stream
+/// pools. Spins on a plain load while locked and yields (Yield::yield) if
+/// that takes more than Max_Spins iterations
+template <typename Yield, size_t Max_Spins> class basic_spinlock {
+public:
+  void lock() noexcept {
+    while (locked.exchange(true, std::memory_order_acquire)) {
+      size_t spins = 0;
+      while (locked.load(std::memory_order_relaxed)) {
+        if (++spins > Max_Spins) {
+          Yield::yield();
+          spins = 0;
+        }
+      }
+    }
+  }
+  bool try_lock() noexcept {
+    return !locked.load(std::memory_order_relaxed) &&
+           !locked.exchange(true, std::memory_order_acquire);
+  }
+  void unlock() noexcept { locked.store(false, std::memory_order_release); }
+
+private:
+  std::atomic<bool> locked{false};
+};
+using spinlock = basic_spinlock<os_thread_yield, 128>;
+
+#if defined(CPPUDDLE_HAVE_HPX_YIELD_SPINLOCK) ||                               \
+    defined(CPPUDDLE_HAVE_HPX_YIELD)
+/// Yields the HPX thread waiting for a lock, so its worker thread can run
+/// other HPX threads meanwhile. Plain threads (e.g. the
+/// memory_pressure_watcher, host_stream_executor workers or std::async
+/// tasks) yield their OS thread instead - they must not use HPX
+/// synchronization primitives such as hpx::lcos::local::mutex
+struct hpx_aware_yield {
+  static void yield() {
+    if (hpx::threads::get_self_ptr() != nullptr) {
+      hpx::this_thread::yield();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+};
+#endif
+
+} // namespace detail
+
+/// Mutex of the buffer_recycler and the stream_pool. Selected at compile time
+/// with one of CPPUDDLE_HAVE_NO_LOCKING, CPPUDDLE_HAVE_SPINLOCK,
+/// CPPUDDLE_HAVE_HPX_YIELD_SPINLOCK or CPPUDDLE_HAVE_HPX_YIELD (std::mutex
+/// otherwise). The HPX variants are spinlocks that yield the HPX thread
+/// instead of the worker thread running it: HPX_YIELD_SPINLOCK spins a while
+/// before each yield, HPX_YIELD yields right away. Waiters get rescheduled
+/// rather than parked. There is no suspending HPX mutex variant, as plain
+/// threads lock the mutex as well - e.g. the memory_pressure_watcher and the
+/// host_stream_executor workers.
+#if defined(CPPUDDLE_HAVE_NO_LOCKING)
+using mutex_t = detail::no_mutex;
+#elif defined(CPPUDDLE_HAVE_SPINLOCK)
+using mutex_t = detail::spinlock;
+#elif defined(CPPUDDLE_HAVE_HPX_YIELD_SPINLOCK)
+using mutex_t = detail::basic_spinlock<detail::hpx_aware_yield, 128>;
+#elif defined(CPPUDDLE_HAVE_HPX_YIELD)
+using mutex_t = detail::basic_spinlock<detail::hpx_aware_yield, 0>;
+#else
+using mutex_t = std::mutex;
+#endif
+
+} // end namespace recycler
+
+#endif
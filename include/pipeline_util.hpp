@@ -0,0 +1,143 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef PIPELINE_UTIL_HPP
+#define PIPELINE_UTIL_HPP
+
+#include "buffer_manager.hpp"
+#include "stream_manager.hpp"
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace recycler {
+namespace detail {
+
+/// Combines the futures returned by async_execute of an interface into one
+/// future that also keeps the pipeline resources alive until it is ready.
+/// Specialized for other future types (e.g. HPX futures in
+/// hpx_stream_util.hpp).
+template <typename Future> struct pipeline_future_traits;
+template <typename T> struct pipeline_future_traits<std::future<T>> {
+  template <typename State>
+  static std::future<void> when_all(std::vector<std::future<T>> &&futures,
+                                    std::shared_ptr<State> state) {
+    return std::async(std::launch::async,
+                      [futures = std::move(futures), state]() mutable {
+                        for (auto &fut : futures) {
+                          fut.get();
+                        }
+                        state.reset(); // release before becoming ready
+                      });
+  }
+};
+
+/// Buffer obtained from the recycler for the lifetime of this object
+template <typename T, typename Host_Allocator> struct recycled_raw_buffer {
+  explicit recycled_raw_buffer(size_t number_elements)
+      : number_elements(number_elements),
+        data(buffer_recycler::get<T, Host_Allocator>(number_elements)) {}
+  ~recycled_raw_buffer() {
+    buffer_recycler::mark_unused<T, Host_Allocator>(data, number_elements);
+  }
+  recycled_raw_buffer(const recycled_raw_buffer &other) = delete;
+  recycled_raw_buffer &operator=(const recycled_raw_buffer &other) = delete;
+  recycled_raw_buffer(recycled_raw_buffer &&other) = delete;
+  recycled_raw_buffer &operator=(recycled_raw_buffer &&other) = delete;
+
+  const size_t number_elements;
+  T *const data;
+};
+
+/// Resources of one pipeline run: the recycled chunk buffers and the
+/// interfaces of the stages. The buffer is a member of its own, so it gets
+/// returned to the recycler even if obtaining an interface throws
+template <class Interface, class Pool, typename T, typename Host_Allocator>
+struct pipeline_state {
+  using allocator_type = typename std::allocator_traits<
+      Host_Allocator>::template rebind_alloc<T>;
+  pipeline_state(size_t chunk_size, size_t depth)
+      : buffer(chunk_size * depth) {
+    for (size_t slot = 0; slot < depth; slot++) {
+      interfaces.emplace_back(
+          std::make_unique<stream_interface<Interface, Pool>>());
+    }
+  }
+
+  recycled_raw_buffer<T, allocator_type> buffer;
+  std::vector<std::unique_ptr<stream_interface<Interface, Pool>>> interfaces;
+};
+
+/// Marks the end of the pipeline on each interface
+struct pipeline_end {
+  void operator()() const noexcept {}
+};
+
+} // namespace detail
+
+/**
+ * Streams number_elements elements in chunks of chunk_size elements through
+ * the accelerator. depth chunk buffers get allocated once (as one recycled
+ * buffer) and each gets its own interface from the pool. Chunk i uses buffer
+ * and interface i % depth: Its stages
+ *   copy_in(interface, chunk_buffer, chunk_offset, chunk_elements),
+ *   compute(interface, chunk_buffer, chunk_offset, chunk_elements) and
+ *   copy_out(interface, chunk_buffer, chunk_offset, chunk_elements)
+ * are expected to enqueue their work on the given interface (e.g. with post).
+ * The in-order semantics of the interfaces ensure that a buffer is only
+ * reused once its previous chunk is done, while the chunks on the other
+ * interfaces overlap with it (depth 2 results in double buffering).
+ *
+ * All three stages of a chunk run one after another on the same interface,
+ * so the overlap of copies and computations only happens between chunks on
+ * different interfaces: Copying chunk i+1 while computing chunk i requires
+ * a depth of at least 2 and an accelerator that runs the streams of the
+ * interfaces concurrently.
+ *
+ * Returns a future that becomes ready once all chunks are done.
+ */
+template <class Interface, class Pool, typename T,
+          typename Host_Allocator = std::allocator<T>, typename Copy_In,
+          typename Compute, typename Copy_Out>
+auto launch_chunked_pipeline(size_t number_elements, size_t chunk_size,
+                             size_t depth, Copy_In &&copy_in,
+                             Compute &&compute, Copy_Out &&copy_out) {
+  assert(chunk_size > 0);
+  assert(depth > 0);
+  using state_type =
+      detail::pipeline_state<Interface, Pool, T, Host_Allocator>;
+  const size_t number_chunks = (number_elements + chunk_size - 1) / chunk_size;
+  // No need for more buffers than chunks
+  auto state = std::make_shared<state_type>(
+      chunk_size, std::max<size_t>(std::min(depth, number_chunks), 1));
+  const size_t number_slots = state->interfaces.size();
+  for (size_t chunk = 0; chunk < number_chunks; chunk++) {
+    const size_t slot = chunk % number_slots;
+    Interface &interface = state->interfaces[slot]->interface;
+    T *chunk_buffer = state->buffer.data + slot * chunk_size; // NOLINT
+    const size_t chunk_offset = chunk * chunk_size;
+    const size_t chunk_elements =
+        std::min(chunk_size, number_elements - chunk_offset);
+    copy_in(interface, chunk_buffer, chunk_offset, chunk_elements);
+    compute(interface, chunk_buffer, chunk_offset, chunk_elements);
+    copy_out(interface, chunk_buffer, chunk_offset, chunk_elements);
+  }
+  using future_type = decltype(
+      state->interfaces[0]->async_execute(detail::pipeline_end{}));
+  std::vector<future_type> futures;
+  futures.reserve(number_slots);
+  for (auto &interface : state->interfaces) {
+    futures.push_back(interface->async_execute(detail::pipeline_end{}));
+  }
+  return detail::pipeline_future_traits<future_type>::when_all(
+      std::move(futures), std::move(state));
+}
+
+} // namespace recycler
+
+#endif
@@ -0,0 +1,146 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef STAGING_BUFFER_UTIL_HPP
+#define STAGING_BUFFER_UTIL_HPP
+
+#include "buffer_manager.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace recycler {
+
+namespace detail {
+
+/**
+ * Ring of number_slots staging buffers of slot_size bytes each, located in
+ * one recycled buffer of the Host_Allocator (usually pinned memory). Large
+ * transfers between pageable host memory and another memory space get split
+ * into slot sized chunks: The host memcpy of one chunk into (or out of) the
+ * staging ring overlaps with the asynchronous copies of the other chunks.
+ *
+ * The asynchronous copy is given by the caller as a function
+ * async_copy(void *destination, const void *source, size_t bytes) returning a
+ * future (anything with get()), e.g. a cudaMemcpyAsync on a stream
+ * interface. Use one ring per interface.
+ */
+template <typename Host_Allocator> class staging_ring {
+private:
+  using byte_allocator = typename std::allocator_traits<
+      Host_Allocator>::template rebind_alloc<unsigned char>;
+  static constexpr size_t slot_alignment = 64;
+
+public:
+  staging_ring(size_t slot_size, size_t number_slots)
+      : slot_size((slot_size + slot_alignment - 1) / slot_alignment *
+                  slot_alignment),
+        number_slots(number_slots), total_bytes(this->slot_size * number_slots) {
+    assert(slot_size > 0);
+    assert(number_slots > 0);
+    buffer = buffer_recycler::get<unsigned char, byte_allocator>(total_bytes);
+  }
+  ~staging_ring() {
+    buffer_recycler::mark_unused<unsigned char, byte_allocator>(buffer,
+                                                                total_bytes);
+  }
+
+  /// Copies bytes from the (pageable) source through the staging ring to the
+  /// destination. Returns once all asynchronous copies are done.
+  template <typename Async_Copy>
+  void copy_to(void *destination, const void *source, size_t bytes,
+               Async_Copy &&async_copy) {
+    using future_type =
+        decltype(async_copy(destination, static_cast<const void *>(buffer),
+                            size_t{}));
+    std::vector<future_type> pending(number_slots);
+    std::vector<bool> slot_used(number_slots, false);
+    const size_t number_chunks = get_number_chunks(bytes);
+    for (size_t chunk = 0; chunk < number_chunks; chunk++) {
+      const size_t slot = chunk % number_slots;
+      if (slot_used[slot]) {
+        pending[slot].get(); // wait until the staging slot is free again
+      }
+      const size_t offset = chunk * slot_size;
+      const size_t chunk_bytes = std::min(slot_size, bytes - offset);
+      std::memcpy(get_slot(slot), static_cast<const char *>(source) + offset,
+                  chunk_bytes);
+      pending[slot] = async_copy(static_cast<char *>(destination) + offset,
+                                 static_cast<const void *>(get_slot(slot)),
+                                 chunk_bytes);
+      slot_used[slot] = true;
+    }
+    for (size_t slot = 0; slot < number_slots; slot++) {
+      if (slot_used[slot]) {
+        pending[slot].get();
+      }
+    }
+  }
+
+  /// Copies bytes from the source through the staging ring to the
+  /// (pageable) destination. Returns once all data arrived in destination.
+  template <typename Async_Copy>
+  void copy_from(void *destination, const void *source, size_t bytes,
+                 Async_Copy &&async_copy) {
+    using future_type = decltype(async_copy(static_cast<void *>(buffer),
+                                            source, size_t{}));
+    std::vector<future_type> pending(number_slots);
+    const size_t number_chunks = get_number_chunks(bytes);
+    auto start_chunk = [&](size_t chunk) {
+      const size_t offset = chunk * slot_size;
+      pending[chunk % number_slots] = async_copy(
+          static_cast<void *>(get_slot(chunk % number_slots)),
+          static_cast<const char *>(source) + offset,
+          std::min(slot_size, bytes - offset));
+    };
+    for (size_t chunk = 0; chunk < std::min(number_slots, number_chunks);
+         chunk++) {
+      start_chunk(chunk);
+    }
+    for (size_t chunk = 0; chunk < number_chunks; chunk++) {
+      const size_t slot = chunk % number_slots;
+      pending[slot].get();
+      const size_t offset = chunk * slot_size;
+      std::memcpy(static_cast<char *>(destination) + offset, get_slot(slot),
+                  std::min(slot_size, bytes - offset));
+      if (chunk + number_slots < number_chunks) {
+        start_chunk(chunk + number_slots);
+      }
+    }
+  }
+
+  size_t get_slot_size() const noexcept { return slot_size; }
+  size_t get_number_slots() const noexcept { return number_slots; }
+
+  // not yet implemented
+  staging_ring(staging_ring const &other) = delete;
+  staging_ring operator=(staging_ring const &other) = delete;
+  staging_ring(staging_ring &&other) = delete;
+  staging_ring operator=(staging_ring &&other) = delete;
+
+private:
+  unsigned char *get_slot(size_t slot) const noexcept {
+    return buffer + slot * slot_size; // NOLINT
+  }
+  size_t get_number_chunks(size_t bytes) const noexcept {
+    return (bytes + slot_size - 1) / slot_size;
+  }
+
+  const size_t slot_size;
+  const size_t number_slots;
+  const size_t total_bytes;
+  unsigned char *buffer{nullptr};
+};
+
+} // end namespace detail
+
+/// Staging ring in recycled host memory (mainly for testing)
+using staging_ring_std = detail::staging_ring<std::allocator<unsigned char>>;
+
+} // end namespace recycler
+
+#endif
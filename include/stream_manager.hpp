@@ -7,49 +7,401 @@
 #define STREAM_MANAGER_HPP
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "mutex_util.hpp"
+
+#if defined(CPPUDDLE_HAVE_HPX)
+#include <hpx/include/runtime.hpp>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
 //#include <cuda_runtime.h>
 // #include <hpx/compute/cuda/target.hpp>
 // #include <hpx/include/compute.hpp>
 
+namespace recycler {
+namespace detail {
+
+/// Reference counter occupying a full cache line
+struct alignas(64) padded_ref_counter {
+  std::atomic<size_t> value{0};
+};
+
+/// Array of padded_ref_counters, each starting its own cache line - counters
+/// of different interfaces thus never share one. Aligns the storage itself as
+/// operator new only guarantees the alignment of max_align_t before C++17
+class ref_counter_array {
+public:
+  explicit ref_counter_array(size_t number_counters)
+      : storage(new unsigned char[(number_counters + 1) * // NOLINT
+                                  sizeof(padded_ref_counter)]) {
+    void *aligned_storage = storage.get();
+    size_t space = (number_counters + 1) * sizeof(padded_ref_counter);
+    aligned_storage = std::align(alignof(padded_ref_counter),
+                                 number_counters * sizeof(padded_ref_counter),
+                                 aligned_storage, space);
+    assert(aligned_storage);
+    counters = static_cast<padded_ref_counter *>(aligned_storage);
+    for (size_t i = 0; i < number_counters; i++) {
+      ::new (static_cast<void *>(counters + i)) padded_ref_counter();
+    }
+  }
+  padded_ref_counter &operator[](size_t index) noexcept {
+    return counters[index];
+  }
+  const padded_ref_counter &operator[](size_t index) const noexcept {
+    return counters[index];
+  }
+
+private:
+  // padded_ref_counter is trivially destructible - releasing the storage
+  // suffices
+  std::unique_ptr<unsigned char[]> storage; // NOLINT
+  padded_ref_counter *counters{nullptr};
+};
+
+/// Number of workers of the thread_affine_pool: The HPX worker threads if the
+/// HPX runtime is running, the online CPUs otherwise
+inline size_t get_number_workers() {
+#if defined(CPPUDDLE_HAVE_HPX)
+  if (hpx::get_runtime_ptr() != nullptr) {
+    return std::max<size_t>(hpx::get_os_thread_count(), 1);
+  }
+#endif
+  return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+/// Index of the calling worker: The HPX worker thread number on HPX worker
+/// threads, the CPU the thread currently runs on otherwise (Linux). Threads
+/// without either get numbered in the order of their first call
+inline size_t get_worker_index() noexcept {
+#if defined(CPPUDDLE_HAVE_HPX)
+  const std::size_t worker_thread = hpx::get_worker_thread_num();
+  if (worker_thread != static_cast<std::size_t>(-1)) {
+    return worker_thread;
+  }
+#endif
+#if defined(__linux__)
+  const int cpu = sched_getcpu();
+  if (cpu >= 0) {
+    return static_cast<size_t>(cpu);
+  }
+#endif
+  static std::atomic<size_t> next_thread_index{0};
+  static thread_local const size_t thread_index = next_thread_index++;
+  return thread_index;
+}
+
+/// Lock guard that does not lock anything (used for thread-safe pools)
+struct no_lock_guard {
+  explicit no_lock_guard(mutex_t & /*unused*/) noexcept {}
+};
+
+/// Pools can declare themselves thread-safe with a static constexpr member
+/// is_thread_safe = true. The stream_pool does not lock access to them.
+template <class Pool, class = void>
+struct is_thread_safe_pool : std::false_type {};
+template <class Pool>
+struct is_thread_safe_pool<Pool, std::enable_if_t<Pool::is_thread_safe>>
+    : std::true_type {};
+
+/// Binary min-heap of the indices 0..n-1, ordered by their loads. The
+/// position of each index within the heap is tracked, so changing the load of
+/// an index only costs O(log n) instead of rebuilding the heap.
+class indexed_load_heap {
+public:
+  explicit indexed_load_heap(size_t number_entries)
+      : loads(number_entries, 0), heap(number_entries),
+        positions(number_entries) {
+    for (size_t i = 0; i < number_entries; i++) {
+      heap[i] = i;
+      positions[i] = i;
+    }
+  }
+  /// Index with the lowest load
+  size_t top() const noexcept { return heap[0]; }
+  size_t top_load() const noexcept { return loads[heap[0]]; }
+  size_t load(size_t index) const noexcept { return loads[index]; }
+  size_t size() const noexcept { return heap.size(); }
+  void increase(size_t index, size_t amount = 1) noexcept {
+    loads[index] += amount;
+    sift_down(positions[index]);
+  }
+  void decrease(size_t index, size_t amount = 1) noexcept {
+    assert(loads[index] >= amount);
+    loads[index] -= amount;
+    sift_up(positions[index]);
+  }
+
+private:
+  std::vector<size_t> loads{};     // load per index
+  std::vector<size_t> heap{};      // heap of indices
+  std::vector<size_t> positions{}; // position of each index within the heap
+
+  void swap_entries(size_t first, size_t second) noexcept {
+    std::swap(heap[first], heap[second]);
+    positions[heap[first]] = first;
+    positions[heap[second]] = second;
+  }
+  void sift_up(size_t position) noexcept {
+    while (position > 0) {
+      const size_t parent = (position - 1) / 2;
+      if (loads[heap[parent]] <= loads[heap[position]]) {
+        return;
+      }
+      swap_entries(parent, position);
+      position = parent;
+    }
+  }
+  void sift_down(size_t position) noexcept {
+    const size_t number_entries = heap.size();
+    while (true) {
+      const size_t left = 2 * position + 1;
+      const size_t right = left + 1;
+      size_t smallest = position;
+      if (left < number_entries && loads[heap[left]] < loads[heap[smallest]]) {
+        smallest = left;
+      }
+      if (right < number_entries &&
+          loads[heap[right]] < loads[heap[smallest]]) {
+        smallest = right;
+      }
+      if (smallest == position) {
+        return;
+      }
+      swap_entries(smallest, position);
+      position = smallest;
+    }
+  }
+};
+
+template <class Future>
+auto future_is_ready(const Future &future, int /*preferred*/)
+    -> decltype(future.is_ready()) {
+  return future.is_ready(); // e.g. hpx::future
+}
+template <class Future>
+bool future_is_ready(const Future &future, long /*fallback*/) {
+  return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+/// Returns a check whether all work submitted to the interface so far is
+/// done. Uses get_future() (e.g. the HPX cuda_executor) or an empty task
+/// behind the pending ones (async_execute, e.g. the host_stream_executor).
+/// Interfaces without either have no work to wait for
+template <class Interface>
+auto pending_work_check(Interface &interface, int /*get_future*/)
+    -> decltype(interface.get_future(), std::function<bool()>()) {
+  auto future = std::make_shared<decltype(interface.get_future())>(
+      interface.get_future());
+  return [future]() { return future_is_ready(*future, 0); };
+}
+/// Task without any work (lambdas are not allowed in decltype before C++20)
+struct empty_task {
+  void operator()() const noexcept {}
+};
+template <class Interface>
+auto pending_work_check(Interface &interface, long /*async_execute*/)
+    -> decltype(interface.async_execute(empty_task{}),
+                std::function<bool()>()) {
+  auto future =
+      std::make_shared<decltype(interface.async_execute(empty_task{}))>(
+          interface.async_execute(empty_task{}));
+  return [future]() { return future_is_ready(*future, 0); };
+}
+template <class Interface>
+std::function<bool()> pending_work_check(Interface & /*interface*/, ...) {
+  return []() { return true; };
+}
+
+} // namespace detail
+} // namespace recycler
+
 template <class Interface> class round_robin_pool {
 private:
   std::vector<Interface> pool{};
-  std::vector<size_t> ref_counters{};
-  size_t current_interface{0};
+  recycler::detail::ref_counter_array ref_counters;
+  std::atomic<size_t> current_interface{0};
 
 public:
+  /// All methods only use atomic operations
+  static constexpr bool is_thread_safe = true;
+
   template <typename... Ts>
-  explicit round_robin_pool(size_t number_of_streams, Ts &&... executor_args) {
+  explicit round_robin_pool(size_t number_of_streams, Ts &&... executor_args)
+      : ref_counters(number_of_streams) {
     pool.reserve(number_of_streams);
-    ref_counters.reserve(number_of_streams);
-    for (int i = 0; i < number_of_streams; i++) {
+    for (size_t i = 0; i < number_of_streams; i++) {
       pool.emplace_back(std::forward<Ts>(executor_args)...);
-      ref_counters.emplace_back(0);
     }
   }
+  // Required for the multi-gpu pools (not thread-safe)
+  round_robin_pool(round_robin_pool &&other) noexcept
+      : pool(std::move(other.pool)),
+        ref_counters(std::move(other.ref_counters)),
+        current_interface(other.current_interface.load()) {}
+  round_robin_pool(const round_robin_pool &other) = delete;
+  round_robin_pool &operator=(const round_robin_pool &other) = delete;
+  round_robin_pool &operator=(round_robin_pool &&other) = delete;
+  ~round_robin_pool() = default;
+
   // return a tuple with the interface and its index (to release it later)
-  std::tuple<Interface &, size_t> get_interface() {
-    size_t last_interface = current_interface;
-    current_interface = (current_interface + 1) % pool.size();
-    ref_counters[last_interface]++;
+  std::tuple<Interface &, size_t> get_interface(size_t weight = 1) {
+    const size_t last_interface =
+        current_interface.fetch_add(1, std::memory_order_relaxed) %
+        pool.size();
+    ref_counters[last_interface].value += weight;
     std::tuple<Interface &, size_t> ret(pool[last_interface], last_interface);
     return ret;
   }
-  void release_interface(size_t index) { ref_counters[index]--; }
+  void release_interface(size_t index, size_t weight = 1) {
+    ref_counters[index].value -= weight;
+  }
   bool interface_available(size_t load_limit) {
-    return *(std::min_element(std::begin(ref_counters),
-                              std::end(ref_counters))) < load_limit;
+    return get_current_load() < load_limit;
   }
   size_t get_current_load() {
-    return *(
-        std::min_element(std::begin(ref_counters), std::end(ref_counters)));
+    size_t min_load = ref_counters[0].value;
+    for (size_t i = 1; i < pool.size(); i++) {
+      min_load = std::min<size_t>(min_load, ref_counters[i].value);
+    }
+    return min_load;
+  }
+  size_t get_next_device_id() {
+    return 0; // single gpu pool
+  }
+};
+
+/// Parameters of the thread_affine_pool
+struct thread_affine_pool_config {
+  /// Threads only steal interfaces of other partitions once all interfaces of
+  /// their own partition reach this load. Given in the units of the weights
+  /// passed to get_interface (e.g. bytes or microseconds of work)
+  size_t steal_load_limit{2};
+  /// 0 uses one partition per worker (at most one partition per interface)
+  size_t number_partitions{0};
+  /// Number of workers the worker indices range over - 0 uses
+  /// recycler::detail::get_number_workers()
+  size_t number_workers{0};
+  /// Index of the calling worker - nullptr uses
+  /// recycler::detail::get_worker_index()
+  size_t (*worker_index)(){nullptr};
+};
+
+/// Partitions the interfaces among the worker threads: Each worker uses the
+/// least loaded interface of its own partition and only steals interfaces
+/// from other partitions if all of its own ones have a load of at least
+/// steal_load_limit. Consecutive tasks of one worker thus stay on the same
+/// few streams. Workers are HPX worker threads (or the CPUs the threads run
+/// on, see get_worker_index) and get mapped to the partitions in contiguous
+/// blocks, so neighbouring workers (usually within the same NUMA domain)
+/// share their streams.
+template <class Interface> class thread_affine_pool {
+private:
+  std::vector<Interface> pool{};
+  recycler::detail::ref_counter_array ref_counters;
+  size_t partitions{1};
+  size_t steal_load_limit{2};
+  size_t number_workers{1};
+  size_t (*worker_index)(){recycler::detail::get_worker_index};
+
+  size_t least_loaded(size_t begin, size_t end) const noexcept {
+    size_t min_index = begin;
+    size_t min_load = ref_counters[begin].value;
+    for (size_t i = begin + 1; i < end; i++) {
+      const size_t load = ref_counters[i].value;
+      if (load < min_load) {
+        min_load = load;
+        min_index = i;
+      }
+    }
+    return min_index;
+  }
+
+public:
+  /// All methods only use atomic operations
+  static constexpr bool is_thread_safe = true;
+
+  template <typename... Ts>
+  explicit thread_affine_pool(size_t number_of_streams, Ts &&... executor_args)
+      : thread_affine_pool(number_of_streams, thread_affine_pool_config{},
+                           std::forward<Ts>(executor_args)...) {}
+  template <typename... Ts>
+  thread_affine_pool(size_t number_of_streams,
+                     thread_affine_pool_config pool_config,
+                     Ts &&... executor_args)
+      : ref_counters(number_of_streams),
+        steal_load_limit(pool_config.steal_load_limit),
+        number_workers(pool_config.number_workers > 0
+                           ? pool_config.number_workers
+                           : recycler::detail::get_number_workers()) {
+    if (pool_config.worker_index) {
+      worker_index = pool_config.worker_index;
+    }
+    const size_t requested_partitions = pool_config.number_partitions > 0
+                                            ? pool_config.number_partitions
+                                            : number_workers;
+    partitions = std::max<size_t>(
+        std::min<size_t>(requested_partitions, number_of_streams), 1);
+    pool.reserve(number_of_streams);
+    for (size_t i = 0; i < number_of_streams; i++) {
+      pool.emplace_back(std::forward<Ts>(executor_args)...);
+    }
+  }
+  // Required for the multi-gpu pools (not thread-safe)
+  thread_affine_pool(thread_affine_pool &&other) noexcept
+      : pool(std::move(other.pool)),
+        ref_counters(std::move(other.ref_counters)),
+        partitions(other.partitions),
+        steal_load_limit(other.steal_load_limit),
+        number_workers(other.number_workers),
+        worker_index(other.worker_index) {}
+  thread_affine_pool(const thread_affine_pool &other) = delete;
+  thread_affine_pool &operator=(const thread_affine_pool &other) = delete;
+  thread_affine_pool &operator=(thread_affine_pool &&other) = delete;
+  ~thread_affine_pool() = default;
+
+  // return a tuple with the interface and its index (to release it later)
+  std::tuple<Interface &, size_t> get_interface(size_t weight = 1) {
+    const size_t partition =
+        worker_index() % number_workers * partitions / number_workers;
+    const size_t partition_begin = partition * pool.size() / partitions;
+    const size_t partition_end = (partition + 1) * pool.size() / partitions;
+    size_t index = least_loaded(partition_begin, partition_end);
+    if (ref_counters[index].value >= steal_load_limit) {
+      const size_t global_index = least_loaded(0, pool.size());
+      if (ref_counters[global_index].value < ref_counters[index].value) {
+        index = global_index;
+      }
+    }
+    ref_counters[index].value += weight;
+    std::tuple<Interface &, size_t> ret(pool[index], index);
+    return ret;
+  }
+  void release_interface(size_t index, size_t weight = 1) {
+    ref_counters[index].value -= weight;
+  }
+  bool interface_available(size_t load_limit) {
+    return get_current_load() < load_limit;
+  }
+  size_t get_current_load() {
+    return ref_counters[least_loaded(0, pool.size())].value;
   }
   size_t get_next_device_id() {
     return 0; // single gpu pool
@@ -59,45 +411,184 @@ public:
 template <class Interface> class priority_pool {
 private:
   std::vector<Interface> pool{};
-  std::vector<size_t> ref_counters{}; // Ref counters
-  std::vector<size_t> priorities{};   // Ref counters
+  recycler::detail::indexed_load_heap priorities; // Ref counters
 public:
   template <typename... Ts>
-  explicit priority_pool(size_t number_of_streams, Ts &&... executor_args) {
+  explicit priority_pool(size_t number_of_streams, Ts &&... executor_args)
+      : priorities(number_of_streams) {
     pool.reserve(number_of_streams);
-    for (auto i = 0; i < number_of_streams; i++) {
+    for (size_t i = 0; i < number_of_streams; i++) {
       pool.emplace_back(std::forward<Ts>(executor_args)...);
-      ref_counters.emplace_back(0);
-      priorities.emplace_back(i);
     }
   }
   // return a tuple with the interface and its index (to release it later)
-  std::tuple<Interface &, size_t> get_interface() {
-    auto &interface = pool[priorities[0]];
-    ref_counters[priorities[0]]++;
-    std::tuple<Interface &, size_t> ret(interface, priorities[0]);
-    std::make_heap(std::begin(priorities), std::end(priorities),
-                   [this](const size_t &first, const size_t &second) -> bool {
-                     return ref_counters[first] > ref_counters[second];
-                   });
+  std::tuple<Interface &, size_t> get_interface(size_t weight = 1) {
+    const size_t index = priorities.top();
+    priorities.increase(index, weight);
+    std::tuple<Interface &, size_t> ret(pool[index], index);
     return ret;
   }
-  void release_interface(size_t index) {
-    ref_counters[index]--;
-    std::make_heap(std::begin(priorities), std::end(priorities),
-                   [this](const size_t &first, const size_t &second) -> bool {
-                     return ref_counters[first] > ref_counters[second];
-                   });
+  void release_interface(size_t index, size_t weight = 1) {
+    priorities.decrease(index, weight);
   }
   bool interface_available(size_t load_limit) {
-    return ref_counters[priorities[0]] < load_limit;
+    return priorities.top_load() < load_limit;
   }
-  size_t get_current_load() { return ref_counters[priorities[0]]; }
+  size_t get_current_load() { return priorities.top_load(); }
   size_t get_next_device_id() {
     return 0; // single gpu pool
   }
 };
 
+/// Sizing parameters of the adaptive_pool. The windows count acquisitions
+/// (calls of get_interface), not time: The pool only adapts while it is
+/// used, and a window spans less time the higher the acquisition rate is
+struct adaptive_pool_config {
+  /// The pool never retires interfaces below this number
+  size_t min_streams{1};
+  /// The pool never creates interfaces beyond this number
+  size_t max_streams{64};
+  /// Grow if the minimum load is at least grow_load_threshold during
+  /// grow_window consecutive acquisitions
+  size_t grow_load_threshold{2};
+  size_t grow_window{32};
+  /// Retire an idle interface if there was still an idle interface after
+  /// each of shrink_window consecutive acquisitions
+  size_t shrink_window{1024};
+};
+
+/// Grow/shrink events of an adaptive_pool
+struct adaptive_pool_statistics {
+  size_t number_streams{0};
+  size_t peak_number_streams{0};
+  size_t grow_events{0};
+  size_t shrink_events{0};
+  size_t acquisitions{0};
+  /// Retired interfaces still waiting for their work to finish
+  size_t retiring_streams{0};
+};
+
+/// Priority pool that starts with number_of_streams interfaces and adapts
+/// the number of interfaces to the load: It creates another interface when
+/// all interfaces stay loaded and retires idle interfaces when there is
+/// spare capacity. The indices of the interfaces are stable - retired slots
+/// get excluded from the heap by an unreachable load. An idle interface may
+/// still have work in flight (its load only counts acquisitions), so retired
+/// interfaces only get destroyed once their work is done (checked by later
+/// acquisitions, see pending_work_check).
+template <class Interface> class adaptive_pool {
+private:
+  static constexpr size_t retired_load = std::numeric_limits<size_t>::max() / 2;
+  adaptive_pool_config config;
+  std::function<std::unique_ptr<Interface>()> create_interface;
+  std::vector<std::unique_ptr<Interface>> slots{};
+  std::vector<size_t> retired_slots{};
+  /// Retired interfaces and the checks whether their work is done
+  std::vector<std::pair<std::unique_ptr<Interface>, std::function<bool()>>>
+      retiring{};
+  recycler::detail::indexed_load_heap priorities; // Ref counters
+  adaptive_pool_statistics statistics{};
+  size_t loaded_acquisitions{0};
+  size_t idle_acquisitions{0};
+
+  void grow() {
+    const size_t index = retired_slots.back();
+    retired_slots.pop_back();
+    slots[index] = create_interface();
+    priorities.decrease(index, retired_load);
+    statistics.number_streams++;
+    statistics.peak_number_streams = std::max(statistics.peak_number_streams,
+                                              statistics.number_streams);
+    statistics.grow_events++;
+  }
+  void shrink(size_t index) {
+    assert(priorities.load(index) == 0);
+    priorities.increase(index, retired_load);
+    auto work_done = recycler::detail::pending_work_check(*slots[index], 0);
+    retiring.emplace_back(std::move(slots[index]), std::move(work_done));
+    retired_slots.push_back(index);
+    statistics.number_streams--;
+    statistics.shrink_events++;
+    destroy_finished_interfaces();
+  }
+  void destroy_finished_interfaces() {
+    retiring.erase(
+        std::remove_if(retiring.begin(), retiring.end(),
+                       [](const auto &entry) { return entry.second(); }),
+        retiring.end());
+  }
+
+public:
+  template <typename... Ts>
+  adaptive_pool(size_t number_of_streams, adaptive_pool_config pool_config,
+                Ts &&... executor_args)
+      : config(pool_config),
+        create_interface([executor_args...]() {
+          return std::make_unique<Interface>(executor_args...);
+        }),
+        slots(pool_config.max_streams), priorities(pool_config.max_streams) {
+    assert(config.min_streams >= 1);
+    assert(config.min_streams <= number_of_streams);
+    assert(number_of_streams <= config.max_streams);
+    for (size_t i = config.max_streams; i-- > number_of_streams;) {
+      priorities.increase(i, retired_load);
+      retired_slots.push_back(i);
+    }
+    for (size_t i = 0; i < number_of_streams; i++) {
+      slots[i] = create_interface();
+    }
+    statistics.number_streams = number_of_streams;
+    statistics.peak_number_streams = number_of_streams;
+  }
+
+  // return a tuple with the interface and its index (to release it later)
+  std::tuple<Interface &, size_t> get_interface(size_t weight = 1) {
+    statistics.acquisitions++;
+    if (!retiring.empty()) {
+      destroy_finished_interfaces();
+    }
+    if (priorities.top_load() >= config.grow_load_threshold) {
+      loaded_acquisitions++;
+      if (loaded_acquisitions >= config.grow_window &&
+          !retired_slots.empty()) {
+        grow();
+        loaded_acquisitions = 0;
+      }
+    } else {
+      loaded_acquisitions = 0;
+    }
+    const size_t index = priorities.top();
+    priorities.increase(index, weight);
+    std::tuple<Interface &, size_t> ret(*slots[index], index);
+    if (priorities.top_load() == 0 && priorities.top() != index) {
+      idle_acquisitions++;
+      if (idle_acquisitions >= config.shrink_window &&
+          statistics.number_streams > config.min_streams) {
+        shrink(priorities.top());
+        idle_acquisitions = 0;
+      }
+    } else {
+      idle_acquisitions = 0;
+    }
+    return ret;
+  }
+  void release_interface(size_t index, size_t weight = 1) {
+    priorities.decrease(index, weight);
+  }
+  bool interface_available(size_t load_limit) {
+    return priorities.top_load() < load_limit;
+  }
+  size_t get_current_load() { return priorities.top_load(); }
+  size_t get_next_device_id() {
+    return 0; // single gpu pool
+  }
+  adaptive_pool_statistics get_statistics() const {
+    adaptive_pool_statistics current = statistics;
+    current.retiring_streams = retiring.size();
+    return current;
+  }
+};
+
 template <class Interface, class Pool> class multi_gpu_round_robin_pool {
 private:
   using gpu_entry = std::tuple<Pool, size_t>; // interface, ref counter
@@ -118,21 +609,21 @@ public:
   }
 
   // return a tuple with the interface and its index (to release it later)
-  std::tuple<Interface &, size_t> get_interface() {
+  std::tuple<Interface &, size_t> get_interface(size_t weight = 1) {
     size_t last_interface = current_interface;
     current_interface = (current_interface + 1) % pool.size();
-    std::get<1>(pool[last_interface])++;
+    std::get<1>(pool[last_interface]) += weight;
     size_t gpu_offset = last_interface * streams_per_gpu;
     std::tuple<Interface &, size_t> stream_entry =
-        std::get<0>(pool[last_interface]).get_interface();
+        std::get<0>(pool[last_interface]).get_interface(weight);
     std::get<1>(stream_entry) += gpu_offset;
     return stream_entry;
   }
-  void release_interface(size_t index) {
+  void release_interface(size_t index, size_t weight = 1) {
     size_t gpu_index = index / streams_per_gpu;
     size_t stream_index = index % streams_per_gpu;
-    std::get<1>(pool[gpu_index])--;
-    std::get<0>(pool[gpu_index]).release_interface(stream_index);
+    std::get<1>(pool[gpu_index]) -= weight;
+    std::get<0>(pool[gpu_index]).release_interface(stream_index, weight);
   }
   bool interface_available(size_t load_limit) {
     auto &current_min_gpu = std::get<0>(*(std::min_element(
@@ -155,8 +646,7 @@ public:
 
 template <class Interface, class Pool> class priority_pool_multi_gpu {
 private:
-  std::vector<size_t> priorities{};
-  std::vector<size_t> ref_counters{};
+  recycler::detail::indexed_load_heap priorities; // Ref counters per GPU
   std::vector<Pool> gpu_interfaces{};
   size_t streams_per_gpu{0};
 
@@ -164,52 +654,59 @@ public:
   template <typename... Ts>
   priority_pool_multi_gpu(size_t number_of_streams, int number_of_gpus,
                           Ts &&... executor_args)
-      : streams_per_gpu(number_of_streams) {
+      : priorities(number_of_gpus), streams_per_gpu(number_of_streams) {
     for (auto gpu_id = 0; gpu_id < number_of_gpus; gpu_id++) {
-      priorities.emplace_back(gpu_id);
-      ref_counters.emplace_back(0);
       gpu_interfaces.emplace_back(streams_per_gpu, gpu_id,
                                   std::forward<Ts>(executor_args)...);
     }
   }
   // return a tuple with the interface and its index (to release it later)
-  std::tuple<Interface &, size_t> get_interface() {
-    auto gpu = priorities[0];
-    ref_counters[gpu]++;
-    std::make_heap(std::begin(priorities), std::end(priorities),
-                   [this](const size_t &first, const size_t &second) -> bool {
-                     return ref_counters[first] > ref_counters[second];
-                   });
+  std::tuple<Interface &, size_t> get_interface(size_t weight = 1) {
+    auto gpu = priorities.top();
+    priorities.increase(gpu, weight);
     size_t gpu_offset = gpu * streams_per_gpu;
-    auto stream_entry = gpu_interfaces[gpu].get_interface();
+    auto stream_entry = gpu_interfaces[gpu].get_interface(weight);
     std::get<1>(stream_entry) += gpu_offset;
     return stream_entry;
   }
-  void release_interface(size_t index) {
+  void release_interface(size_t index, size_t weight = 1) {
     size_t gpu_index = index / streams_per_gpu;
     size_t stream_index = index % streams_per_gpu;
-    ref_counters[gpu_index]--;
-    std::make_heap(std::begin(priorities), std::end(priorities),
-                   [this](const size_t &first, const size_t &second) -> bool {
-                     return ref_counters[first] > ref_counters[second];
-                   });
-    gpu_interfaces[gpu_index].release_interface(stream_index);
+    priorities.decrease(gpu_index, weight);
+    gpu_interfaces[gpu_index].release_interface(stream_index, weight);
   }
   bool interface_available(size_t load_limit) {
-    return gpu_interfaces[priorities[0]].interface_available(load_limit);
+    return gpu_interfaces[priorities.top()].interface_available(load_limit);
   }
   size_t get_current_load() {
-    return gpu_interfaces[priorities[0]].get_current_load();
+    return gpu_interfaces[priorities.top()].get_current_load();
   }
-  size_t get_next_device_id() { return priorities[0]; }
+  size_t get_next_device_id() { return priorities.top(); }
+};
+
+/// Pool with its own identity: stream_pool keeps one pool per Interface/Pool
+/// type pair, so the same Pool with different Tags (any type, e.g. an empty
+/// struct per subsystem) results in independent pools with their own
+/// interfaces, loads and locks. Example:
+/// using hydro_pool = named_pool<priority_pool<executor>, struct hydro_tag>;
+template <class Pool, class Tag> class named_pool : public Pool {
+public:
+  using Pool::Pool;
+  using tag_type = Tag;
 };
 
 /// Access/Concurrency Control for stream pool implementation
+///
+/// The load of an interface is the sum of the weights of its outstanding
+/// acquisitions. The weight is the expected cost of the work submitted with
+/// it (in any unit, e.g. bytes, flops or microseconds) and defaults to 1 (pure
+/// reference counting). Releases have to use the same weight as the
+/// corresponding acquisition.
 class stream_pool {
 public:
   template <class Interface, class Pool, typename... Ts>
   static void init(size_t number_of_streams, Ts &&... executor_args) {
-    std::lock_guard<std::mutex> guard(mut);
+    std::lock_guard<recycler::mutex_t> guard(mut);
     if (!access_instance) {
       // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
       access_instance.reset(new stream_pool());
@@ -218,51 +715,81 @@ public:
         number_of_streams, std::forward<Ts>(executor_args)...);
   }
   template <class Interface, class Pool> static void cleanup() {
-    std::lock_guard<std::mutex> guard(mut);
+    std::lock_guard<recycler::mutex_t> guard(mut);
     stream_pool_implementation<Interface, Pool>::cleanup();
   }
   template <class Interface, class Pool>
-  static std::tuple<Interface &, size_t> get_interface() {
-    std::lock_guard<std::mutex> guard(mut);
+  static std::tuple<Interface &, size_t> get_interface(size_t weight = 1) {
     assert(access_instance); // should already be initialized
-    return stream_pool_implementation<Interface, Pool>::get_interface();
+    return stream_pool_implementation<Interface, Pool>::get_interface(weight);
   }
   template <class Interface, class Pool>
-  static void release_interface(size_t index) noexcept {
-    std::lock_guard<std::mutex> guard(mut);
+  static void release_interface(size_t index, size_t weight = 1) noexcept {
     assert(access_instance); // should already be initialized
-    stream_pool_implementation<Interface, Pool>::release_interface(index);
+    stream_pool_implementation<Interface, Pool>::release_interface(index,
+                                                                   weight);
+  }
+  /// Calls callback(interface, index) as soon as an interface with a load
+  /// below load_limit is available - either directly or within the
+  /// release_interface call that brings the load below the limit. Waiting
+  /// requests are served in FIFO order. The callback takes over the reference
+  /// and has to release the interface later on. It should not throw: A
+  /// callback that throws did not take over the interface - it gets released
+  /// again and the exception is dropped, as releases are noexcept
+  template <class Interface, class Pool, typename F>
+  static void get_interface_when_available(size_t load_limit, F &&callback,
+                                           size_t weight = 1) {
+    assert(access_instance); // should already be initialized
+    stream_pool_implementation<Interface, Pool>::get_interface_when_available(
+        load_limit, std::forward<F>(callback), weight);
+  }
+  template <class Interface, class Pool>
+  static size_t get_number_waiting_requests() noexcept {
+    assert(access_instance); // should already be initialized
+    return stream_pool_implementation<Interface,
+                                      Pool>::get_number_waiting_requests();
   }
   template <class Interface, class Pool>
   static bool interface_available(size_t load_limit) noexcept {
-    std::lock_guard<std::mutex> guard(mut);
     assert(access_instance); // should already be initialized
     return stream_pool_implementation<Interface, Pool>::interface_available(
         load_limit);
   }
   template <class Interface, class Pool>
   static size_t get_current_load() noexcept {
-    std::lock_guard<std::mutex> guard(mut);
     assert(access_instance); // should already be initialized
     return stream_pool_implementation<Interface, Pool>::get_current_load();
   }
   template <class Interface, class Pool>
   static size_t get_next_device_id() noexcept {
-    std::lock_guard<std::mutex> guard(mut);
     assert(access_instance); // should already be initialized
     return stream_pool_implementation<Interface, Pool>::get_next_device_id();
   }
+  /// Only available for pools with statistics (e.g. the adaptive_pool)
+  template <class Interface, class Pool>
+  static decltype(auto) get_statistics() noexcept {
+    assert(access_instance); // should already be initialized
+    return stream_pool_implementation<Interface, Pool>::get_statistics();
+  }
 
 private:
   static std::unique_ptr<stream_pool> access_instance;
-  static std::mutex mut;
+  static recycler::mutex_t mut;
   stream_pool() = default;
 
 private:
   template <class Interface, class Pool> class stream_pool_implementation {
+  private:
+    /// Thread-safe pools do not require any locking - all others get locked
+    /// with the mutex of this pool type
+    using pool_lock_guard = std::conditional_t<
+        recycler::detail::is_thread_safe_pool<Pool>::value,
+        recycler::detail::no_lock_guard, std::lock_guard<recycler::mutex_t>>;
+
   public:
     template <typename... Ts>
     static void init(size_t number_of_streams, Ts &&... executor_args) {
+      std::lock_guard<recycler::mutex_t> guard(pool_mut);
       // TODO(daissgr) What should happen if the instance already exists?
       // warning?
       if (!pool_instance && number_of_streams > 0) {
@@ -274,25 +801,57 @@ private:
       }
     }
     static void cleanup() {
+      std::lock_guard<recycler::mutex_t> guard(pool_mut);
+      assert(pool_instance->number_waiters == 0); // nobody should be waiting
       pool_instance->streampool.reset(nullptr);
       pool_instance.reset(nullptr);
     }
 
-    static std::tuple<Interface &, size_t> get_interface() noexcept {
+    static std::tuple<Interface &, size_t>
+    get_interface(size_t weight) noexcept {
+      pool_lock_guard guard(pool_mut);
       assert(pool_instance); // should already be initialized
-      return pool_instance->streampool->get_interface();
+      return pool_instance->streampool->get_interface(weight);
     }
-    static void release_interface(size_t index) noexcept {
+    static void release_interface(size_t index, size_t weight) noexcept {
+      {
+        pool_lock_guard guard(pool_mut);
+        assert(pool_instance); // should already be initialized
+        pool_instance->streampool->release_interface(index, weight);
+      }
+      if (pool_instance->number_waiters > 0) {
+        serve_waiters();
+      }
+    }
+    static void get_interface_when_available(
+        size_t load_limit, std::function<void(Interface &, size_t)> callback,
+        size_t weight) {
       assert(pool_instance); // should already be initialized
-      pool_instance->streampool->release_interface(index);
+      // Increment before enqueuing: A concurrent release either sees the
+      // waiter or happens before serve_waiters checks the load
+      pool_instance->number_waiters++;
+      try {
+        std::lock_guard<recycler::mutex_t> guard(pool_instance->waiter_mut);
+        pool_instance->waiters.push(
+            waiter{load_limit, weight, std::move(callback)});
+      } catch (...) {
+        pool_instance->number_waiters--;
+        throw;
+      }
+      serve_waiters();
+    }
+    static size_t get_number_waiting_requests() noexcept {
+      return pool_instance ? pool_instance->number_waiters.load() : 0;
     }
     static bool interface_available(size_t load_limit) noexcept {
+      pool_lock_guard guard(pool_mut);
       if (!pool_instance) {
         return false;
       }
       return pool_instance->streampool->interface_available(load_limit);
     }
     static size_t get_current_load() noexcept {
+      pool_lock_guard guard(pool_mut);
       if (!pool_instance) {
         return 0;
       }
@@ -300,17 +859,76 @@ private:
       return pool_instance->streampool->get_current_load();
     }
     static size_t get_next_device_id() noexcept {
+      pool_lock_guard guard(pool_mut);
       if (!pool_instance) {
         return 0;
       }
       return pool_instance->streampool->get_next_device_id();
     }
+    static decltype(auto) get_statistics() noexcept {
+      pool_lock_guard guard(pool_mut);
+      assert(pool_instance); // should already be initialized
+      return pool_instance->streampool->get_statistics();
+    }
 
   private:
+    struct waiter {
+      size_t load_limit;
+      size_t weight;
+      std::function<void(Interface &, size_t)> callback;
+    };
+
+    /// Hands out interfaces to the waiting requests (in order) as long as the
+    /// load permits it. The callbacks get called one at a time without
+    /// holding any lock. Called by the noexcept releases, thus it allocates
+    /// nothing and releases the interface of a callback that throws
+    static void serve_waiters() noexcept {
+      while (true) {
+        std::function<void(Interface &, size_t)> callback;
+        Interface *interface = nullptr;
+        size_t index = 0;
+        size_t weight = 0;
+        {
+          std::lock_guard<recycler::mutex_t> waiter_guard(
+              pool_instance->waiter_mut);
+          auto &waiters = pool_instance->waiters;
+          if (waiters.empty()) {
+            return;
+          }
+          auto &next = waiters.front();
+          pool_lock_guard guard(pool_mut);
+          if (!pool_instance->streampool->interface_available(
+                  next.load_limit)) {
+            return;
+          }
+          auto served = pool_instance->streampool->get_interface(next.weight);
+          callback = std::move(next.callback);
+          interface = &std::get<0>(served);
+          index = std::get<1>(served);
+          weight = next.weight;
+          waiters.pop();
+          pool_instance->number_waiters--;
+        }
+        try {
+          callback(*interface, index);
+        } catch (...) {
+          pool_lock_guard guard(pool_mut);
+          pool_instance->streampool->release_interface(index, weight);
+        }
+      }
+    }
+
     static std::unique_ptr<stream_pool_implementation> pool_instance;
+    /// One mutex per pool type - pools of different types do not block each
+    /// other. Not used for the access methods of thread-safe pools.
+    static recycler::mutex_t pool_mut;
     stream_pool_implementation() = default;
 
     std::unique_ptr<Pool> streampool{nullptr};
+    /// Requests waiting for an interface (FIFO)
+    recycler::mutex_t waiter_mut;
+    std::queue<waiter> waiters;
+    std::atomic<size_t> number_waiters{0};
 
   public:
     ~stream_pool_implementation() = default;
@@ -333,22 +951,34 @@ public:
   stream_pool &operator=(stream_pool &&other) = delete;
 };
 
+#if defined(CPPUDDLE_HAVE_HEADER_ONLY)
+// Header-only mode: The singleton state gets defined here instead of in the
+// stream_manager library
+inline std::unique_ptr<stream_pool> stream_pool::access_instance{};
+inline recycler::mutex_t stream_pool::mut{};
+#endif
+
 template <class Interface, class Pool>
 std::unique_ptr<stream_pool::stream_pool_implementation<Interface, Pool>>
     stream_pool::stream_pool_implementation<Interface, Pool>::pool_instance{};
+template <class Interface, class Pool>
+recycler::mutex_t
+    stream_pool::stream_pool_implementation<Interface, Pool>::pool_mut{};
 
 template <class Interface, class Pool> class stream_interface {
 public:
-  explicit stream_interface()
-      : t(stream_pool::get_interface<Interface, Pool>()),
-        interface(std::get<0>(t)), interface_index(std::get<1>(t)) {}
+  /// weight: expected cost of the work submitted through this interface
+  explicit stream_interface(size_t weight = 1)
+      : t(stream_pool::get_interface<Interface, Pool>(weight)),
+        interface_index(std::get<1>(t)), weight(weight),
+        interface(std::get<0>(t)) {}
 
   stream_interface(const stream_interface &other) = delete;
   stream_interface &operator=(const stream_interface &other) = delete;
   stream_interface(stream_interface &&other) = delete;
   stream_interface &operator=(stream_interface &&other) = delete;
   ~stream_interface() {
-    stream_pool::release_interface<Interface, Pool>(interface_index);
+    stream_pool::release_interface<Interface, Pool>(interface_index, weight);
   }
 
   template <typename F, typename... Ts>
@@ -371,9 +1001,100 @@ public:
 private:
   std::tuple<Interface &, size_t> t;
   size_t interface_index;
+  size_t weight;
 
 public:
   Interface &interface;
 };
 
+namespace recycler {
+namespace detail {
+template <typename F, typename Tuple, size_t... I, typename... Appended_Args>
+void invoke_with_tuple(F &f, Tuple &args, std::index_sequence<I...> /*unused*/,
+                       Appended_Args &&... appended_args) {
+  f(std::get<I>(args)..., std::forward<Appended_Args>(appended_args)...);
+}
+} // namespace detail
+} // namespace recycler
+
+/**
+ * stream_interface that coalesces consecutive post() calls: The calls get
+ * buffered and submitted to the interface as one batched post once
+ * max_batch_size calls are buffered, before each async_execute (in-order
+ * semantics stay intact), by get_interface and on destruction. Each
+ * submission thus only pays the dispatch overhead of the executor once.
+ *
+ * There is no timeout: A partial batch stays buffered until one of the
+ * above happens. Call flush() before waiting on anything that depends on
+ * the posted calls without going through this interface.
+ *
+ * Appended_Args are the arguments the executor appends to posted functions
+ * (e.g. the cudaStream_t for HPX cuda executors) - the batch forwards them to
+ * each buffered call.
+ */
+template <class Interface, class Pool, typename... Appended_Args>
+class coalescing_stream_interface {
+public:
+  explicit coalescing_stream_interface(size_t max_batch_size = 32,
+                                       size_t weight = 1)
+      : stream(weight), max_batch_size(max_batch_size) {
+    batch.reserve(max_batch_size);
+  }
+  coalescing_stream_interface(const coalescing_stream_interface &other) =
+      delete;
+  coalescing_stream_interface &
+  operator=(const coalescing_stream_interface &other) = delete;
+  coalescing_stream_interface(coalescing_stream_interface &&other) = delete;
+  coalescing_stream_interface &
+  operator=(coalescing_stream_interface &&other) = delete;
+  ~coalescing_stream_interface() { flush(); }
+
+  template <typename F, typename... Ts> void post(F &&f, Ts &&... ts) {
+    batch.emplace_back([f = std::forward<F>(f),
+                        args = std::make_tuple(std::forward<Ts>(ts)...)](
+                           Appended_Args... appended_args) mutable {
+      recycler::detail::invoke_with_tuple(
+          f, args, std::index_sequence_for<Ts...>{}, appended_args...);
+    });
+    if (batch.size() >= max_batch_size) {
+      flush();
+    }
+  }
+
+  template <typename F, typename... Ts>
+  inline decltype(auto) async_execute(F &&f, Ts &&... ts) {
+    flush();
+    return stream.async_execute(std::forward<F>(f), std::forward<Ts>(ts)...);
+  }
+
+  /// Submits all buffered calls as one post
+  void flush() {
+    if (batch.empty()) {
+      return;
+    }
+    std::vector<std::function<void(Appended_Args...)>> submitted_batch;
+    submitted_batch.reserve(max_batch_size);
+    std::swap(submitted_batch, batch);
+    stream.post([submitted_batch = std::move(submitted_batch)](
+                    Appended_Args... appended_args) {
+      for (auto &call : submitted_batch) {
+        call(appended_args...);
+      }
+    });
+  }
+
+  inline size_t get_gpu_id() noexcept { return stream.get_gpu_id(); }
+
+  /// Direct access to the interface (submits the buffered calls first)
+  Interface &get_interface() {
+    flush();
+    return stream.interface;
+  }
+
+private:
+  stream_interface<Interface, Pool> stream;
+  std::vector<std::function<void(Appended_Args...)>> batch{};
+  const size_t max_batch_size;
+};
+
 #endif
@@ -5,7 +5,9 @@
 
 #include "../include/buffer_manager.hpp"
 
-// Instance defintions
+// Instance defintions (part of the headers in header-only mode)
+#if !defined(CPPUDDLE_HAVE_HEADER_ONLY)
 std::unique_ptr<recycler::detail::buffer_recycler>
     recycler::detail::buffer_recycler::recycler_instance{};
-std::mutex recycler::detail::buffer_recycler::mut{};
+recycler::mutex_t recycler::detail::buffer_recycler::mut{};
+#endif
@@ -5,6 +5,8 @@
 
 #include "../include/stream_manager.hpp"
 
-// Instance defintions
+// Instance defintions (part of the headers in header-only mode)
+#if !defined(CPPUDDLE_HAVE_HEADER_ONLY)
 std::unique_ptr<stream_pool> stream_pool::access_instance{};
-std::mutex stream_pool::mut{};
+recycler::mutex_t stream_pool::mut{};
+#endif
@@ -0,0 +1,177 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+#ifndef CPPUDDLE_HAVE_ATTRIBUTION
+#error "This test requires CPPUDDLE_HAVE_ATTRIBUTION"
+#endif
+
+void print_statistics() {
+  for (const auto &entry : recycler::get_attribution_statistics()) {
+    std::cout << "==> " << entry.first
+              << ": in use = " << entry.second.bytes_in_use
+              << "B, cached = " << entry.second.bytes_cached
+              << "B, requests = " << entry.second.number_requests
+              << ", creations = " << entry.second.number_creations
+              << std::endl;
+  }
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t array_size = 100000;
+  size_t number_threads = 4;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "arraysize",
+        boost::program_options::value<size_t>(&array_size)
+            ->default_value(100000),
+        "Size of the buffers")(
+        "threads",
+        boost::program_options::value<size_t>(&number_threads)
+            ->default_value(4),
+        "Number of threads with their own attribution tag")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --arraysize = " << array_size << std::endl
+                << " --threads = " << number_threads << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(array_size >= 1);     // NOLINT
+  assert(number_threads >= 1); // NOLINT
+  const size_t bytes = array_size * sizeof(double);
+
+  using allocator_type = recycler::recycle_std<double>;
+  const allocator_type hydro_alloc(0, "hydro");
+  const allocator_type gravity_alloc(0, "gravity");
+  {
+    std::vector<double, allocator_type> hydro_buffer(array_size, double{},
+                                                     hydro_alloc);
+    auto statistics = recycler::get_attribution_statistics();
+    assert(statistics["hydro"].bytes_in_use == bytes);
+    assert(statistics["hydro"].number_creations == 1);
+  }
+  // The released buffer stays cached on behalf of its last user...
+  auto statistics = recycler::get_attribution_statistics();
+  assert(statistics["hydro"].bytes_in_use == 0);
+  assert(statistics["hydro"].bytes_cached == bytes);
+  {
+    // ... until someone else recycles it
+    std::vector<double, allocator_type> gravity_buffer(array_size, double{},
+                                                       gravity_alloc);
+    statistics = recycler::get_attribution_statistics();
+    assert(statistics["hydro"].bytes_cached == 0);
+    assert(statistics["gravity"].bytes_in_use == bytes);
+    assert(statistics["gravity"].number_creations == 0);
+    {
+      // Tagged with the callsite
+      std::vector<double, allocator_type> callsite_buffer(
+          array_size, double{}, allocator_type(0, CPPUDDLE_CALLSITE));
+    }
+    std::vector<double, allocator_type> second_gravity_buffer(
+        2 * array_size, double{}, gravity_alloc);
+    statistics = recycler::get_attribution_statistics();
+    assert(statistics["gravity"].bytes_in_use == 3 * bytes);
+    assert(statistics["gravity"].number_requests == 2);
+  }
+  bool found_callsite = false;
+  for (const auto &entry : recycler::get_attribution_statistics()) {
+    if (entry.first.find("allocator_attribution_test.cpp:") !=
+        std::string::npos) {
+      found_callsite = true;
+      assert(entry.second.bytes_cached == bytes);
+    }
+  }
+  assert(found_callsite);
+  // Without a tag
+  {
+    std::vector<double, allocator_type> untagged_buffer(3 * array_size,
+                                                        double{});
+    statistics = recycler::get_attribution_statistics();
+    assert(statistics["untagged"].bytes_in_use == 3 * bytes);
+  }
+  // Copies of the allocator (e.g. within containers) keep the tag
+  {
+    allocator_type copied(hydro_alloc);
+    double *data = copied.allocate(array_size);
+    statistics = recycler::get_attribution_statistics();
+    assert(statistics["hydro"].bytes_in_use == bytes);
+    copied.deallocate(data, array_size);
+  }
+
+  // The tag travels with each request - not with the thread
+  std::vector<std::thread> threads;
+  std::vector<std::string> tags(number_threads);
+  for (size_t thread_id = 0; thread_id < number_threads; thread_id++) {
+    tags[thread_id] = "thread " + std::to_string(thread_id);
+  }
+  for (size_t thread_id = 0; thread_id < number_threads; thread_id++) {
+    threads.emplace_back([&tags, thread_id, array_size]() {
+      const allocator_type thread_alloc(0, tags[thread_id].c_str());
+      for (size_t pass = 0; pass < 100; pass++) {
+        std::vector<double, allocator_type> thread_buffer(
+            (thread_id + 4) * array_size, double{}, thread_alloc);
+        std::vector<double, allocator_type> untagged_buffer(
+            (thread_id + 4) * array_size, double{});
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  statistics = recycler::get_attribution_statistics();
+  for (size_t thread_id = 0; thread_id < number_threads; thread_id++) {
+    assert(statistics[tags[thread_id]].number_requests == 100);
+    assert(statistics[tags[thread_id]].number_creations == 1);
+  }
+  assert(statistics["untagged"].number_requests == 1 + 100 * number_threads);
+  print_statistics();
+
+  // Deallocating the cached buffers leaves nothing attributed
+  recycler::cleanup();
+  for (const auto &entry : recycler::get_attribution_statistics()) {
+    assert(entry.second.bytes_in_use == 0);
+    assert(entry.second.bytes_cached == 0);
+  }
+  recycler::force_cleanup();
+  std::cout << "Test information: Attribution is consistent!" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+using recycler_type = recycler::detail::buffer_recycler;
+using host_allocator = std::allocator<double>;
+
+/// Runs passes iterations of acquiring and releasing number_buffers buffers
+/// on each of number_threads threads. Returns the runtime in microseconds
+template <typename F>
+size_t run_threads(const size_t number_threads, F &&thread_function) {
+  std::vector<std::thread> threads;
+  threads.reserve(number_threads);
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (size_t thread_id = 0; thread_id < number_threads; thread_id++) {
+    threads.emplace_back(thread_function);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+      .count();
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t number_buffers = 32;
+  size_t max_threads = 64;
+  size_t passes = 1000;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "buffers",
+        boost::program_options::value<size_t>(&number_buffers)
+            ->default_value(32),
+        "Number of buffers acquired and released together by each task")(
+        "max_threads",
+        boost::program_options::value<size_t>(&max_threads)->default_value(64),
+        "Maximum number of threads (doubled from 1 up to this value)")(
+        "passes",
+        boost::program_options::value<size_t>(&passes)->default_value(1000),
+        "Sets the number of repetitions per thread")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --buffers = " << number_buffers << std::endl
+                << " --max_threads = " << max_threads << std::endl
+                << " --passes = " << passes << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(passes >= 1);         // NOLINT
+  assert(number_buffers >= 1); // NOLINT
+  assert(max_threads >= 1);    // NOLINT
+
+  // Unrelated buffers -> different sizes
+  std::vector<size_t> sizes(number_buffers);
+  for (size_t i = 0; i < number_buffers; i++) {
+    sizes[i] = 1024 + i * 8;
+  }
+
+  // Correctness test: batched buffers are usable and get recycled
+  {
+    std::vector<double *> buffers(number_buffers);
+    recycler_type::get_many<double, host_allocator>(
+        sizes.data(), buffers.data(), number_buffers);
+    for (size_t i = 0; i < number_buffers; i++) {
+      buffers[i][sizes[i] - 1] = static_cast<double>(i);
+    }
+    std::vector<double *> old_buffers = buffers;
+    recycler_type::release_many<double, host_allocator>(
+        buffers.data(), sizes.data(), number_buffers);
+    recycler_type::get_many<double, host_allocator>(
+        sizes.data(), buffers.data(), number_buffers);
+    for (size_t i = 0; i < number_buffers; i++) {
+      assert(buffers[i] == old_buffers[i]);
+    }
+    recycler_type::release_many<double, host_allocator>(
+        buffers.data(), sizes.data(), number_buffers);
+  }
+  recycler::force_cleanup();
+
+  size_t total_single_duration = 0;
+  size_t total_batched_duration = 0;
+  for (size_t number_threads = 1; number_threads <= max_threads;
+       number_threads *= 2) {
+    const size_t single_duration = run_threads(number_threads, [&]() {
+      std::vector<double *> buffers(number_buffers);
+      for (size_t pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < number_buffers; i++) {
+          buffers[i] = recycler_type::get<double, host_allocator>(sizes[i]);
+        }
+        for (size_t i = 0; i < number_buffers; i++) {
+          recycler_type::mark_unused<double, host_allocator>(buffers[i],
+                                                             sizes[i]);
+        }
+      }
+    });
+    recycler::force_cleanup();
+    const size_t batched_duration = run_threads(number_threads, [&]() {
+      std::vector<double *> buffers(number_buffers);
+      for (size_t pass = 0; pass < passes; pass++) {
+        recycler_type::get_many<double, host_allocator>(
+            sizes.data(), buffers.data(), number_buffers);
+        recycler_type::release_many<double, host_allocator>(
+            buffers.data(), sizes.data(), number_buffers);
+      }
+    });
+    recycler::force_cleanup();
+    std::cout << "==> " << number_threads << " threads: " << number_buffers
+              << " single calls took " << single_duration
+              << "us, one batched call took " << batched_duration << "us"
+              << std::endl;
+    total_single_duration += single_duration;
+    total_batched_duration += batched_duration;
+  }
+
+  if (total_batched_duration < total_single_duration) {
+    std::cout << "Test information: Batched calls were faster than single "
+                 "calls!"
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
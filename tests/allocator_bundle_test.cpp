@@ -0,0 +1,187 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include "../include/bundle_buffer_util.hpp"
+#include <boost/program_options.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+// Fields of one sub-grid
+using subgrid_bundle =
+    recycler::recycled_bundle_std<double, double, double, double, double,
+                                  double, float, float, int, char>;
+
+template <typename T> bool is_aligned(const T *pointer, size_t alignment) {
+  return reinterpret_cast<std::uintptr_t>(pointer) % alignment == 0;
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t array_size = 500000;
+  size_t passes = 10000;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "arraysize",
+        boost::program_options::value<size_t>(&array_size)
+            ->default_value(100000),
+        "Size of the buffers")(
+        "passes",
+        boost::program_options::value<size_t>(&passes)->default_value(2000),
+        "Sets the number of repetitions")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --arraysize = " << array_size << std::endl
+                << " --passes = " << passes << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(passes >= 1);     // NOLINT
+  assert(array_size >= 1); // NOLINT
+
+  // Layout test: arrays are aligned, sized and do not overlap
+  {
+    // odd sizes to force padding between the arrays
+    recycler::recycled_bundle_std<char, double, float, int64_t> bundle(
+        array_size + 1, array_size + 3, array_size + 5, 7);
+    assert(is_aligned(bundle.data<0>(), 64));
+    assert(is_aligned(bundle.data<1>(), 64));
+    assert(is_aligned(bundle.data<2>(), 64));
+    assert(is_aligned(bundle.data<3>(), 64));
+    assert(bundle.size<0>() == array_size + 1);
+    assert(bundle.size<3>() == 7);
+    auto span0 = bundle.get<0>();
+    auto span1 = bundle.get<1>();
+    auto span2 = bundle.get<2>();
+    auto span3 = bundle.get<3>();
+    assert(reinterpret_cast<const void *>(span0.end()) <=
+           reinterpret_cast<const void *>(span1.begin()));
+    assert(reinterpret_cast<const void *>(span1.end()) <=
+           reinterpret_cast<const void *>(span2.begin()));
+    assert(reinterpret_cast<const void *>(span2.end()) <=
+           reinterpret_cast<const void *>(span3.begin()));
+    // Write everything to catch overlaps with valgrind / sanitizers
+    for (auto &c : span0) {
+      c = 'a';
+    }
+    for (auto &d : span1) {
+      d = 1.0;
+    }
+    for (auto &f : span2) {
+      f = 2.0f;
+    }
+    for (auto &i : span3) {
+      i = 3;
+    }
+    assert(span0[array_size] == 'a');
+    assert(span1[array_size + 2] == 1.0);
+    assert(span2[array_size + 4] == 2.0f);
+    assert(span3[6] == 3);
+  }
+  recycler::force_cleanup(); // Cleanup all buffers and the managers for better
+                             // comparison
+
+  size_t bundle_duration = 0;
+  size_t single_duration = 0;
+
+  // Bundle Test:
+  {
+    std::cout << "\nStarting run with bundled buffers: " << std::endl;
+    auto begin = std::chrono::high_resolution_clock::now();
+    for (size_t pass = 0; pass < passes; pass++) {
+      subgrid_bundle bundle(array_size, array_size, array_size, array_size,
+                            array_size, array_size, array_size, array_size,
+                            array_size, array_size);
+      bundle.data<0>()[pass % array_size] = 1.0;
+      bundle.data<9>()[pass % array_size] = 'b';
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    bundle_duration =
+        std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+            .count();
+    std::cout << "\n==> Bundle allocation test took " << bundle_duration
+              << "us" << std::endl;
+  }
+  recycler::force_cleanup(); // Cleanup all buffers and the managers for better
+                             // comparison
+
+  // Same arrays as separate recycled buffers:
+  {
+    std::cout << "\nStarting run with separate recycled buffers: " << std::endl;
+    auto begin = std::chrono::high_resolution_clock::now();
+    recycler::recycle_std<double> double_alloc;
+    recycler::recycle_std<float> float_alloc;
+    recycler::recycle_std<int> int_alloc;
+    recycler::recycle_std<char> char_alloc;
+    for (size_t pass = 0; pass < passes; pass++) {
+      std::array<double *, 6> doubles{};
+      std::array<float *, 2> floats{};
+      for (auto &d : doubles) {
+        d = double_alloc.allocate(array_size);
+      }
+      for (auto &f : floats) {
+        f = float_alloc.allocate(array_size);
+      }
+      int *i0 = int_alloc.allocate(array_size);
+      char *c0 = char_alloc.allocate(array_size);
+      doubles[0][pass % array_size] = 1.0;
+      c0[pass % array_size] = 'b';
+      for (auto &d : doubles) {
+        double_alloc.deallocate(d, array_size);
+      }
+      for (auto &f : floats) {
+        float_alloc.deallocate(f, array_size);
+      }
+      int_alloc.deallocate(i0, array_size);
+      char_alloc.deallocate(c0, array_size);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    single_duration =
+        std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+            .count();
+    std::cout << "\n==> Separate allocation test took " << single_duration
+              << "us" << std::endl;
+  }
+  recycler::force_cleanup();
+
+  if (bundle_duration < single_duration) {
+    std::cout << "Test information: Bundle was faster than separate buffers!"
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,225 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <hpx/hpx_init.hpp>
+#include <hpx/include/async.hpp>
+#include <hpx/include/lcos.hpp>
+
+#include <hpx/kokkos.hpp>
+
+#include <Kokkos_Core.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <typeinfo>
+
+#include "../include/buffer_manager.hpp"
+#include "../include/kokkos_buffer_util.hpp"
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+// Host views using recycle allocators
+template <class T>
+using kokkos_um_array =
+    Kokkos::View<T **, Kokkos::HostSpace, Kokkos::MemoryUnmanaged>;
+template <class T>
+using recycled_host_view =
+    recycler::recycled_view<kokkos_um_array<T>, recycler::recycle_std<T>, T>;
+// Default (managed) host views for comparison
+template <class T> using kokkos_host_array = Kokkos::View<T **, Kokkos::HostSpace>;
+
+/// Ported host section of the allocator_kokkos_executor_for_loop_test: Fill a
+/// recycled host view with the given executor and verify the result
+template <typename Executor>
+void test_host_views(const std::string &space_name, const size_t passes,
+                     const size_t view_size_0, const size_t view_size_1) {
+  std::cout << "\nStarting recycled view test with " << space_name
+            << " execution space..." << std::endl;
+  for (size_t pass = 0; pass < passes; pass++) {
+    // Create view
+    recycled_host_view<double> hostView(view_size_0, view_size_1);
+
+    // Create executor
+    Executor executor;
+
+    // Obtain execution policy from executor
+    auto policy_1 = get_iteration_policy(executor.instance(), hostView);
+
+    // Run with the execution policy
+    Kokkos::parallel_for(
+        "host init", policy_1,
+        KOKKOS_LAMBDA(int n, int o) { hostView(n, o) = 1.0; });
+    executor.instance().fence();
+
+    // Verify
+    for (size_t i = 0; i < view_size_0; i++) {
+      for (size_t j = 0; j < view_size_1; j++) {
+        assert(hostView(i, j) == 1.0);
+      }
+    }
+  }
+  std::cout << "Finished recycled view test with " << space_name
+            << " execution space!" << std::endl;
+}
+
+/// Compare recycled host views against managed Kokkos::Views: Both get
+/// allocated, filled with the given executor and deallocated each pass
+template <typename Executor>
+void benchmark_host_views(const std::string &space_name, const size_t passes,
+                          const size_t view_size_0, const size_t view_size_1,
+                          size_t &recycle_duration, size_t &default_duration) {
+  Executor executor;
+  {
+    auto begin = std::chrono::high_resolution_clock::now();
+    for (size_t pass = 0; pass < passes; pass++) {
+      recycled_host_view<double> hostView(view_size_0, view_size_1);
+      Kokkos::parallel_for(
+          "recycled view benchmark",
+          get_iteration_policy(executor.instance(), hostView),
+          KOKKOS_LAMBDA(int n, int o) { hostView(n, o) = 1.0; });
+      executor.instance().fence();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const size_t duration =
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - begin)
+            .count();
+    recycle_duration += duration;
+    std::cout << "==> " << space_name << " recycled view test took "
+              << duration << "ms" << std::endl;
+  }
+  {
+    auto begin = std::chrono::high_resolution_clock::now();
+    for (size_t pass = 0; pass < passes; pass++) {
+      // Skip the initialization kernel - recycled views are not initialized
+      // either
+      kokkos_host_array<double> hostView(
+          Kokkos::ViewAllocateWithoutInitializing("managed view"), view_size_0,
+          view_size_1);
+      Kokkos::parallel_for(
+          "managed view benchmark",
+          get_iteration_policy(executor.instance(), hostView),
+          KOKKOS_LAMBDA(int n, int o) { hostView(n, o) = 1.0; });
+      executor.instance().fence();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const size_t duration =
+        std::chrono::duration_cast<std::chrono::milliseconds>(end - begin)
+            .count();
+    default_duration += duration;
+    std::cout << "==> " << space_name << " managed view test took "
+              << duration << "ms" << std::endl;
+  }
+}
+
+int hpx_main(int argc, char *argv[]) {
+  size_t passes = 100;
+  size_t view_size_0 = 10;
+  size_t view_size_1 = 50;
+  size_t benchmark_passes = 10000;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "passes",
+        boost::program_options::value<size_t>(&passes)->default_value(100),
+        "Sets the number of repetitions for the correctness test")(
+        "benchmark_passes",
+        boost::program_options::value<size_t>(&benchmark_passes)
+            ->default_value(10000),
+        "Sets the number of repetitions for the view benchmark")(
+        "viewsize0",
+        boost::program_options::value<size_t>(&view_size_0)->default_value(10),
+        "Extent of the first view dimension")(
+        "viewsize1",
+        boost::program_options::value<size_t>(&view_size_1)->default_value(50),
+        "Extent of the second view dimension")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --passes = " << passes << std::endl
+                << " --benchmark_passes = " << benchmark_passes << std::endl
+                << " --viewsize0 = " << view_size_0 << std::endl
+                << " --viewsize1 = " << view_size_1 << std::endl
+                << " --hpx:threads = " << hpx::get_os_thread_count()
+                << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return hpx::finalize();
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(passes >= 1);      // NOLINT
+  assert(view_size_0 >= 1); // NOLINT
+  assert(view_size_1 >= 1); // NOLINT
+
+  hpx::kokkos::ScopeGuard g(argc, argv);
+  Kokkos::print_configuration(std::cout);
+
+  // Correctness tests for all available host execution spaces
+#if defined(KOKKOS_ENABLE_SERIAL)
+  test_host_views<hpx::kokkos::serial_executor>("Serial", passes, view_size_0,
+                                                view_size_1);
+#endif
+#if defined(KOKKOS_ENABLE_OPENMP)
+  test_host_views<hpx::kokkos::openmp_executor>("OpenMP", passes, view_size_0,
+                                                view_size_1);
+#endif
+#if defined(KOKKOS_ENABLE_HPX)
+  test_host_views<hpx::kokkos::hpx_executor>("HPX", passes, view_size_0,
+                                             view_size_1);
+#endif
+
+  // Recycled vs. managed views
+  size_t recycle_duration = 0;
+  size_t default_duration = 0;
+#if defined(KOKKOS_ENABLE_SERIAL)
+  benchmark_host_views<hpx::kokkos::serial_executor>(
+      "Serial", benchmark_passes, view_size_0, view_size_1, recycle_duration,
+      default_duration);
+#endif
+#if defined(KOKKOS_ENABLE_OPENMP)
+  benchmark_host_views<hpx::kokkos::openmp_executor>(
+      "OpenMP", benchmark_passes, view_size_0, view_size_1, recycle_duration,
+      default_duration);
+#endif
+#if defined(KOKKOS_ENABLE_HPX)
+  benchmark_host_views<hpx::kokkos::hpx_executor>(
+      "HPX", benchmark_passes, view_size_0, view_size_1, recycle_duration,
+      default_duration);
+#endif
+  if (recycle_duration < default_duration) {
+    std::cout << "Test information: Recycled views were faster than managed "
+                 "views!"
+              << std::endl;
+  }
+
+  recycler::force_cleanup();
+  return hpx::finalize();
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> cfg = {"hpx.commandline.allow_unknown=1"};
+  return hpx::init(argc, argv, cfg);
+}
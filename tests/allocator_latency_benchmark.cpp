@@ -0,0 +1,121 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include "../include/stream_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+#include "dummy_interface.hpp"
+
+using recycler_type = recycler::detail::buffer_recycler;
+using host_allocator = std::allocator<double>;
+using pool_type = priority_pool<dummy_interface>;
+
+/// Average latency in nanoseconds of a get/mark_unused pair that recycles
+/// the same buffer every time (the hot path of the recycler)
+double measure_recycler_latency(const size_t number_calls,
+                                const size_t array_size) {
+  // create the buffer once
+  double *buffer = recycler_type::get<double, host_allocator>(array_size);
+  recycler_type::mark_unused<double, host_allocator>(buffer, array_size);
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (size_t call = 0; call < number_calls; call++) {
+    double *recycled = recycler_type::get<double, host_allocator>(array_size);
+    recycler_type::mark_unused<double, host_allocator>(recycled, array_size);
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return static_cast<double>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+                 .count()) /
+         static_cast<double>(number_calls);
+}
+
+/// Average latency in nanoseconds of acquiring and releasing an interface
+double measure_stream_pool_latency(const size_t number_calls) {
+  stream_pool::init<dummy_interface, pool_type>(4);
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (size_t call = 0; call < number_calls; call++) {
+    auto interface = stream_pool::get_interface<dummy_interface, pool_type>();
+    stream_pool::release_interface<dummy_interface, pool_type>(
+        std::get<1>(interface));
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  stream_pool::cleanup<dummy_interface, pool_type>();
+  return static_cast<double>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+                 .count()) /
+         static_cast<double>(number_calls);
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t number_calls = 1000000;
+  size_t array_size = 1000;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "calls",
+        boost::program_options::value<size_t>(&number_calls)
+            ->default_value(1000000),
+        "Number of measured calls")(
+        "arraysize",
+        boost::program_options::value<size_t>(&array_size)
+            ->default_value(1000),
+        "Size of the recycled buffer")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --calls = " << number_calls << std::endl
+                << " --arraysize = " << array_size << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(number_calls >= 1); // NOLINT
+  assert(array_size >= 1);   // NOLINT
+
+#if defined(CPPUDDLE_HAVE_HEADER_ONLY)
+  std::cout << "Singleton state: header-only (inline variables)" << std::endl;
+#else
+  std::cout << "Singleton state: buffer_manager/stream_manager libraries"
+            << std::endl;
+#endif
+  std::cout << "==> Recycler get/mark_unused latency: "
+            << measure_recycler_latency(number_calls, array_size) << "ns"
+            << std::endl;
+  std::cout << "==> Stream pool get/release latency: "
+            << measure_stream_pool_latency(number_calls) << "ns" << std::endl;
+  recycler::force_cleanup();
+  return EXIT_SUCCESS;
+}
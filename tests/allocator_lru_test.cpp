@@ -0,0 +1,133 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+/// Memory shared by all managers - allocations fail once it is used up
+size_t memory_budget = 0;
+size_t memory_used = 0;
+/// Buffers deallocated (evicted) so far
+std::vector<const void *> deallocated_buffers;
+
+template <typename T> struct limited_allocator {
+  using value_type = T;
+  limited_allocator() noexcept = default;
+  template <typename U>
+  explicit limited_allocator(limited_allocator<U> const &) noexcept {}
+  T *allocate(std::size_t n) {
+    if (memory_used + n * sizeof(T) > memory_budget) {
+      throw std::bad_alloc();
+    }
+    memory_used += n * sizeof(T);
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) {
+    memory_used -= n * sizeof(T);
+    deallocated_buffers.push_back(p);
+    std::allocator<T>{}.deallocate(p, n);
+  }
+};
+template <typename T>
+using recycle_limited =
+    recycler::detail::recycle_allocator<T, limited_allocator<T>>;
+
+bool was_evicted(const void *buffer) {
+  return std::find(deallocated_buffers.begin(), deallocated_buffers.end(),
+                   buffer) != deallocated_buffers.end();
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t array_size = 1000;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "arraysize",
+        boost::program_options::value<size_t>(&array_size)
+            ->default_value(1000),
+        "Size of the buffers")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --arraysize = " << array_size << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(array_size >= 1); // NOLINT
+  const size_t bytes = array_size * sizeof(double);
+  memory_budget = 4 * bytes;
+  recycle_limited<double> double_alloc;
+  recycle_limited<float> float_alloc;
+  recycle_limited<int> int_alloc;
+  static_assert(sizeof(float) == sizeof(double) / 2, "Unexpected float size");
+  static_assert(sizeof(int) == sizeof(double) / 2, "Unexpected int size");
+
+  // Unused buffers of two managers, released in interleaved order a, b, c, e
+  double *a = double_alloc.allocate(array_size);
+  double *c = double_alloc.allocate(array_size);
+  float *b = float_alloc.allocate(2 * array_size);
+  float *e = float_alloc.allocate(2 * array_size);
+  double_alloc.deallocate(a, array_size);
+  float_alloc.deallocate(b, 2 * array_size);
+  double_alloc.deallocate(c, array_size);
+  float_alloc.deallocate(e, 2 * array_size);
+  assert(memory_used == memory_budget);
+
+  // A request of a third manager only evicts the oldest buffer...
+  int *first_int = int_alloc.allocate(2 * array_size);
+  assert(deallocated_buffers.size() == 1 && was_evicted(a));
+  // ... and a larger one the next oldest ones, keeping the hot buffer e
+  int *second_int = int_alloc.allocate(4 * array_size);
+  assert(deallocated_buffers.size() == 3 && was_evicted(b) && was_evicted(c));
+  assert(!was_evicted(e));
+  float *recycled = float_alloc.allocate(2 * array_size);
+  assert(recycled == e);
+  float_alloc.deallocate(recycled, 2 * array_size);
+
+  // Trimming (e.g. by the memory_pressure_watcher) uses the same order
+  int_alloc.deallocate(first_int, 2 * array_size);
+  int_alloc.deallocate(second_int, 4 * array_size);
+  assert(recycler::trim(1) == bytes);
+  assert(deallocated_buffers.size() == 4 && was_evicted(e));
+  assert(recycler::trim(bytes + 1) == 3 * bytes);
+  assert(memory_used == 0);
+
+  recycler::force_cleanup();
+  std::cout << "Test information: Least recently used buffers got evicted!"
+            << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include "../include/memory_pressure_util.hpp"
+#include <boost/program_options.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+/// Simulated memory usage for the injected data source
+std::atomic<size_t> simulated_usage{0};
+std::atomic<size_t> simulated_limit{0};
+std::atomic<size_t> number_allocations{0};
+
+template <typename T> struct counting_allocator {
+  using value_type = T;
+  counting_allocator() noexcept = default;
+  template <typename U>
+  explicit counting_allocator(counting_allocator<U> const &) noexcept {}
+  T *allocate(std::size_t n) {
+    number_allocations++;
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) { std::allocator<T>{}.deallocate(p, n); }
+};
+using recycle_counting =
+    recycler::detail::recycle_allocator<double, counting_allocator<double>>;
+
+/// Stands in for a device allocator - the watcher must not trim its buffers
+template <typename T> struct device_allocator : counting_allocator<T> {
+  device_allocator() noexcept = default;
+  template <typename U>
+  explicit device_allocator(device_allocator<U> const &) noexcept {}
+};
+namespace recycler {
+namespace detail {
+template <typename T> struct allocation_failure_traits<device_allocator<T>> {
+  static constexpr memory_kind kind = memory_kind::device;
+  static bool is_out_of_memory(const std::exception &e) noexcept {
+    return dynamic_cast<const std::bad_alloc *>(&e) != nullptr;
+  }
+};
+} // namespace detail
+} // namespace recycler
+using recycle_device =
+    recycler::detail::recycle_allocator<double, device_allocator<double>>;
+
+bool simulated_source(recycler::memory_usage &usage) {
+  usage.bytes_used = simulated_usage;
+  usage.bytes_limit = simulated_limit;
+  return true;
+}
+
+/// Requests number_buffers buffers at the same time and releases them again
+void fill_cache(const size_t number_buffers, const size_t array_size) {
+  std::vector<std::vector<double, recycle_counting>> buffers;
+  for (size_t i = 0; i < number_buffers; i++) {
+    buffers.emplace_back(array_size, double{});
+  }
+}
+
+void write_file(const std::string &filename, const std::string &content) {
+  std::ofstream file(filename);
+  file << content;
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t array_size = 100000;
+  size_t number_buffers = 8;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "arraysize",
+        boost::program_options::value<size_t>(&array_size)
+            ->default_value(100000),
+        "Size of the buffers")(
+        "buffers",
+        boost::program_options::value<size_t>(&number_buffers)
+            ->default_value(8),
+        "Number of cached buffers")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --arraysize = " << array_size << std::endl
+                << " --buffers = " << number_buffers << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(array_size >= 1);     // NOLINT
+  assert(number_buffers >= 4); // NOLINT
+  const size_t bytes = array_size * sizeof(double);
+
+  // Data sources: The cgroup of the process is found via its cgroup file
+  const std::string cgroup_root = "memory_pressure_test_cgroups";
+  std::filesystem::create_directories(cgroup_root + "/job/step");
+  write_file("memory_pressure_test.cgroup",
+             "4:memory:/legacy\n0::/job/step\n");
+  write_file(cgroup_root + "/memory.max", "1024\n"); // not the own cgroup
+  write_file(cgroup_root + "/memory.current", "512\n");
+  write_file(cgroup_root + "/job/step/memory.max", "max\n");
+  write_file(cgroup_root + "/job/step/memory.current", "4096\n");
+  const auto cgroup_source = recycler::cgroup_memory_source(
+      cgroup_root, "memory_pressure_test.cgroup");
+  recycler::memory_usage usage;
+  // no limit -> not usable
+  assert(!cgroup_source(usage));
+  write_file(cgroup_root + "/job/step/memory.max", "8192\n");
+  assert(cgroup_source(usage));
+  assert(usage.bytes_used == 4096 && usage.bytes_limit == 8192);
+  // the root cgroup itself
+  write_file("memory_pressure_test.cgroup", "0::/\n");
+  assert(cgroup_source(usage));
+  assert(usage.bytes_used == 512 && usage.bytes_limit == 1024);
+  // no cgroup v2
+  write_file("memory_pressure_test.cgroup", "4:memory:/legacy\n");
+  assert(!cgroup_source(usage));
+  std::filesystem::remove_all(cgroup_root);
+  std::remove("memory_pressure_test.cgroup");
+  write_file("memory_pressure_test.meminfo",
+             "MemTotal:        1000 kB\nMemFree:          100 kB\n"
+             "MemAvailable:     250 kB\n");
+  assert(recycler::meminfo_memory_source("memory_pressure_test.meminfo")(
+      usage));
+  assert(usage.bytes_limit == 1000 * 1024);
+  assert(usage.bytes_used == 750 * 1024);
+  std::remove("memory_pressure_test.meminfo");
+  assert(!recycler::meminfo_memory_source("memory_pressure_test.meminfo")(
+      usage));
+
+  // Trimming by bytes starts with the buffers unused the longest
+  fill_cache(number_buffers, array_size);
+  assert(number_allocations == number_buffers);
+  assert(recycler::trim(bytes + 1) == 2 * bytes);
+  fill_cache(number_buffers, array_size);
+  assert(number_allocations == number_buffers + 2);
+  assert(recycler::trim(0) == 0);
+
+  // Below the high watermark nothing happens...
+  recycler::memory_pressure_config config;
+  config.high_watermark = 0.9;
+  config.low_watermark = 0.8;
+  config.poll_interval = std::chrono::milliseconds{1};
+  recycler::memory_pressure_watcher watcher(simulated_source, config);
+  simulated_limit = 10 * bytes;
+  simulated_usage = 9 * bytes;
+  assert(watcher.check() == 0);
+  assert(watcher.get_number_trims() == 0);
+  // ... above it, enough gets trimmed to reach the low watermark
+  simulated_usage = 9 * bytes + bytes / 2;
+  assert(watcher.check() == 2 * bytes);
+  assert(watcher.get_number_trims() == 1);
+  fill_cache(number_buffers, array_size);
+  assert(number_allocations == number_buffers + 4);
+  // Device buffers do not count against the host memory
+  {
+    std::vector<double, recycle_device> device_buffer(array_size, double{});
+  }
+  assert(number_allocations == number_buffers + 5);
+  simulated_usage = 20 * bytes;
+  assert(watcher.check() == number_buffers * bytes);
+  assert(recycler::trim(bytes, recycler::memory_kind::device) == bytes);
+  fill_cache(number_buffers, array_size);
+  assert(number_allocations == 2 * number_buffers + 5);
+
+  // The same in the background
+  watcher.start();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (watcher.get_number_trims() < 3 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  simulated_usage = 0; // pressure gone
+  assert(watcher.get_number_trims() >= 3);
+  watcher.stop();
+  assert(watcher.get_bytes_trimmed() >= (number_buffers + 4) * bytes);
+
+  // The real data sources should simply not crash without a cgroup
+  recycler::memory_pressure_watcher default_watcher;
+  default_watcher.check();
+
+  recycler::force_cleanup();
+  std::cout << "==> Trimmed " << watcher.get_bytes_trimmed() << " bytes in "
+            << watcher.get_number_trims() << " trims" << std::endl;
+  std::cout << "Test information: Memory pressure triggered trimming!"
+            << std::endl;
+  return EXIT_SUCCESS;
+}
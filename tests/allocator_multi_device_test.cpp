@@ -0,0 +1,196 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <array>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+/// Book keeping of the fake devices
+std::array<size_t, recycler::max_number_gpus> allocations_per_location{};
+std::array<size_t, recycler::max_number_gpus> deallocations_per_location{};
+std::unordered_map<const void *, size_t> buffer_locations{};
+
+/// Host memory pretending to be the memory of max_number_gpus devices
+template <typename T> struct fake_device_allocator {
+  using value_type = T;
+  fake_device_allocator() noexcept = default;
+  template <typename U>
+  explicit fake_device_allocator(fake_device_allocator<U> const &) noexcept {}
+  T *allocate(std::size_t n) { return std::allocator<T>{}.allocate(n); }
+  void deallocate(T *p, std::size_t n) { std::allocator<T>{}.deallocate(p, n); }
+};
+
+namespace recycler {
+namespace detail {
+template <typename T>
+struct allocation_failure_traits<fake_device_allocator<T>> {
+  static constexpr memory_kind kind = memory_kind::device;
+  static bool is_out_of_memory(const std::exception &e) noexcept {
+    return dynamic_cast<const std::bad_alloc *>(&e) != nullptr;
+  }
+};
+/// Remembers the (fake) device each buffer got allocated on
+template <typename T>
+struct location_allocator_traits<fake_device_allocator<T>> {
+  static T *allocate(fake_device_allocator<T> &alloc, size_t number_elements,
+                     size_t location_id) {
+    T *data = alloc.allocate(number_elements);
+    allocations_per_location[location_id]++;
+    buffer_locations[data] = location_id;
+    return data;
+  }
+  static void deallocate(fake_device_allocator<T> &alloc, T *p,
+                         size_t number_elements, size_t location_id) {
+    auto it = buffer_locations.find(p);
+    assert(it != buffer_locations.end());
+    assert(it->second == location_id); // freed on the device of the allocation
+    buffer_locations.erase(it);
+    deallocations_per_location[location_id]++;
+    alloc.deallocate(p, number_elements);
+  }
+};
+} // namespace detail
+} // namespace recycler
+
+template <typename T>
+using recycle_fake_device =
+    recycler::detail::recycle_allocator<T, fake_device_allocator<T>>;
+
+int main(int argc, char *argv[]) {
+
+  size_t array_size = 100000;
+  size_t passes = 100;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "arraysize",
+        boost::program_options::value<size_t>(&array_size)
+            ->default_value(100000),
+        "Size of the buffers")(
+        "passes",
+        boost::program_options::value<size_t>(&passes)->default_value(100),
+        "Sets the number of repetitions per location")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --arraysize = " << array_size << std::endl
+                << " --passes = " << passes << std::endl
+                << " with " << recycler::max_number_gpus << " locations"
+                << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(array_size >= 1);                // NOLINT
+  assert(passes >= 1);                    // NOLINT
+  assert(recycler::max_number_gpus >= 2); // NOLINT
+
+  // Buffers of one location must never be handed out for another location
+  for (size_t pass = 0; pass < passes; pass++) {
+    for (size_t location = 0; location < recycler::max_number_gpus;
+         location++) {
+      std::vector<double, recycle_fake_device<double>> test(
+          array_size, double{}, recycle_fake_device<double>{location});
+      auto it = buffer_locations.find(test.data());
+      assert(it != buffer_locations.end());
+      assert(it->second == location);
+    }
+  }
+  // ... thus each location needed exactly one buffer
+  for (size_t location = 0; location < recycler::max_number_gpus; location++) {
+    assert(allocations_per_location[location] == 1);
+  }
+
+  // Unused buffers of other locations are no candidates either
+  double *buffer_location_0 =
+      recycle_fake_device<double>{0}.allocate(2 * array_size);
+  recycle_fake_device<double>{0}.deallocate(buffer_location_0, 2 * array_size);
+  double *buffer_location_1 =
+      recycle_fake_device<double>{1}.allocate(2 * array_size);
+  assert(buffer_location_1 != buffer_location_0);
+  assert(allocations_per_location[1] == 2);
+  double *buffer_location_0_again =
+      recycle_fake_device<double>{0}.allocate(2 * array_size);
+  assert(buffer_location_0_again == buffer_location_0); // recycled
+  assert(allocations_per_location[0] == 2);
+  recycle_fake_device<double>{1}.deallocate(buffer_location_1, 2 * array_size);
+  recycle_fake_device<double>{0}.deallocate(buffer_location_0_again,
+                                            2 * array_size);
+
+  // Allocators of different locations are not interchangeable
+  assert(recycle_fake_device<double>{0} == recycle_fake_device<double>{0});
+  assert(recycle_fake_device<double>{0} != recycle_fake_device<double>{1});
+
+  // Each location has its own memory budget: Exceeding it evicts unused
+  // buffers of that location only - and fails if they do not suffice
+  recycler::force_cleanup();
+  const size_t bytes = array_size * sizeof(double);
+  recycler::set_device_memory_budget(0, 2 * bytes);
+  {
+    std::vector<double, recycle_fake_device<double>> other_location(
+        array_size, double{}, recycle_fake_device<double>{1});
+  }
+  {
+    std::vector<double, recycle_fake_device<double>> first(
+        array_size, double{}, recycle_fake_device<double>{0});
+    std::vector<double, recycle_fake_device<double>> second(
+        array_size, double{}, recycle_fake_device<double>{0});
+    assert(recycler::get_device_memory_usage(0) == 2 * bytes);
+    bool caught = false;
+    try {
+      std::vector<double, recycle_fake_device<double>> third(
+          array_size, double{}, recycle_fake_device<double>{0});
+    } catch (const recycler::out_of_memory_error &e) {
+      caught = true;
+    }
+    assert(caught);
+  }
+  {
+    std::vector<double, recycle_fake_device<double>> larger(
+        2 * array_size, double{}, recycle_fake_device<double>{0});
+    assert(recycler::get_device_memory_usage(0) == 2 * bytes);
+  }
+  assert(recycler::get_device_memory_usage(1) == bytes); // not evicted
+
+  recycler::force_cleanup(); // Cleanup all buffers and the managers
+  assert(buffer_locations.empty());
+  for (size_t location = 0; location < recycler::max_number_gpus; location++) {
+    assert(deallocations_per_location[location] ==
+           allocations_per_location[location]);
+  }
+  std::cout << "Test information: Buffers stayed on their locations!"
+            << std::endl;
+  return EXIT_SUCCESS;
+}
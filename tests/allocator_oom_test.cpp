@@ -0,0 +1,228 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+/// Memory shared by all fake allocators below - allocations fail once it is
+/// used up
+size_t memory_budget = 0;
+size_t memory_used = 0;
+bool device_lost = false;
+
+bool take_budget(size_t bytes) {
+  if (memory_used + bytes > memory_budget) {
+    return false;
+  }
+  memory_used += bytes;
+  return true;
+}
+
+/// Host memory: Throws std::bad_alloc (like std::allocator)
+template <typename T> struct limited_host_allocator {
+  using value_type = T;
+  limited_host_allocator() noexcept = default;
+  template <typename U>
+  explicit limited_host_allocator(
+      limited_host_allocator<U> const &) noexcept {}
+  T *allocate(std::size_t n) {
+    if (!take_budget(n * sizeof(T))) {
+      throw std::bad_alloc();
+    }
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) {
+    memory_used -= n * sizeof(T);
+    std::allocator<T>{}.deallocate(p, n);
+  }
+};
+
+/// Device memory: Throws out_of_memory_error if the memory is used up and
+/// std::runtime_error for all other failures (like the cuda_device_allocator)
+template <typename T> struct limited_device_allocator {
+  using value_type = T;
+  limited_device_allocator() noexcept = default;
+  template <typename U>
+  explicit limited_device_allocator(
+      limited_device_allocator<U> const &) noexcept {}
+  T *allocate(std::size_t n) {
+    if (device_lost) {
+      throw std::runtime_error("limited_device_allocator: device lost");
+    }
+    if (!take_budget(n * sizeof(T))) {
+      throw recycler::out_of_memory_error(
+          "limited_device_allocator: out of memory");
+    }
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) {
+    memory_used -= n * sizeof(T);
+    std::allocator<T>{}.deallocate(p, n);
+  }
+};
+
+namespace recycler {
+namespace detail {
+template <typename T>
+struct allocation_failure_traits<limited_device_allocator<T>> {
+  static constexpr memory_kind kind = memory_kind::device;
+  static bool is_out_of_memory(const std::exception &e) noexcept {
+    return dynamic_cast<const std::bad_alloc *>(&e) != nullptr;
+  }
+};
+} // namespace detail
+} // namespace recycler
+
+template <typename T>
+using recycle_host =
+    recycler::detail::recycle_allocator<T, limited_host_allocator<T>>;
+template <typename T>
+using recycle_device =
+    recycler::detail::recycle_allocator<T, limited_device_allocator<T>>;
+
+/// Requests number_buffers buffers at the same time and releases them again,
+/// leaving them as unused buffers in the recycler
+template <typename Allocator>
+void fill_cache(const size_t number_buffers, const size_t array_size,
+                const Allocator &alloc = Allocator{}) {
+  using T = typename Allocator::value_type;
+  std::vector<std::vector<T, Allocator>> buffers;
+  for (size_t i = 0; i < number_buffers; i++) {
+    buffers.emplace_back(array_size, T{}, alloc);
+  }
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t array_size = 1000;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "arraysize",
+        boost::program_options::value<size_t>(&array_size)
+            ->default_value(1000),
+        "Size of the buffers")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --arraysize = " << array_size << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(array_size >= 1); // NOLINT
+  const size_t bytes = array_size * sizeof(double);
+  memory_budget = 4 * bytes;
+
+  // Stage 1: The unused buffers of the same manager suffice - only as many
+  // of them get evicted as the request needs
+  fill_cache<recycle_device<double>>(4, array_size);
+  assert(memory_used == 4 * bytes);
+  {
+    std::vector<double, recycle_device<double>> larger(2 * array_size);
+    assert(memory_used == 4 * bytes);
+  }
+  recycler::cleanup();
+  assert(memory_used == 0);
+
+  // Stage 2: Unused buffers of other managers of the same memory kind (and
+  // location) - but not the host buffers or other locations
+  fill_cache<recycle_host<double>>(1, array_size);
+  fill_cache<recycle_device<float>>(1, 4 * array_size);
+  if (recycler::max_number_gpus > 1) {
+    memory_budget += bytes;
+    fill_cache(1, array_size, recycle_device<double>{1});
+  }
+  assert(memory_used == memory_budget - bytes);
+  {
+    std::vector<double, recycle_device<double>> larger(2 * array_size);
+    assert(memory_used == memory_budget - bytes);
+  }
+  recycler::cleanup();
+  memory_budget = 4 * bytes;
+
+  // Stage 3: Everything - here the host buffers use up the memory
+  fill_cache<recycle_host<double>>(4, array_size);
+  {
+    std::vector<double, recycle_device<double>> device_buffer(array_size);
+    assert(memory_used == 4 * bytes);
+  }
+  recycler::cleanup();
+
+  // Failing for good: std::bad_alloc turns into out_of_memory_error...
+  fill_cache<recycle_host<double>>(2, array_size);
+  bool caught = false;
+  try {
+    std::vector<double, recycle_host<double>> too_large(5 * array_size);
+  } catch (const recycler::out_of_memory_error &e) {
+    caught = true;
+    std::cout << "==> " << e.what() << std::endl;
+  }
+  assert(caught);
+  assert(memory_used == 0); // everything got trimmed on the way
+  // ... as does the one of the device
+  caught = false;
+  try {
+    std::vector<double, recycle_device<double>> too_large(5 * array_size);
+  } catch (const std::bad_alloc &e) { // out_of_memory_error is a bad_alloc
+    caught = true;
+  }
+  assert(caught);
+  // Other failures are no reason to trim
+  fill_cache<recycle_device<double>>(2, array_size);
+  device_lost = true;
+  caught = false;
+  try {
+    std::vector<double, recycle_device<double>> lost(3 * array_size);
+  } catch (const recycler::out_of_memory_error &e) {
+    assert(false);
+  } catch (const std::runtime_error &e) {
+    caught = true;
+  }
+  assert(caught);
+  assert(memory_used == 2 * bytes);
+  device_lost = false;
+
+  // The recycler is still usable after all that (no deadlock in the retry)
+  {
+    std::vector<double, recycle_device<double>> recycled(array_size);
+    assert(memory_used == 2 * bytes);
+  }
+  recycler::force_cleanup();
+  assert(memory_used == 0);
+  std::cout << "Test information: Out-of-memory retries behaved as expected!"
+            << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+std::atomic<size_t> number_allocations{0};
+std::chrono::microseconds allocation_latency{0};
+
+/// Host allocator with the (simulated) latency of a device allocation
+template <typename T> struct slow_allocator {
+  using value_type = T;
+  slow_allocator() noexcept = default;
+  template <typename U>
+  explicit slow_allocator(slow_allocator<U> const &) noexcept {}
+  T *allocate(std::size_t n) {
+    number_allocations++;
+    std::this_thread::sleep_for(allocation_latency);
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) { std::allocator<T>{}.deallocate(p, n); }
+};
+
+using recycle_slow = recycler::detail::recycle_allocator<
+    double, slow_allocator<double>>;
+
+/// Simulation steps needing the same working set every time. Returns the
+/// runtime of the first step in microseconds
+size_t run_steps(const size_t number_steps, const size_t array_size) {
+  size_t first_step_duration = 0;
+  for (size_t step = 0; step < number_steps; step++) {
+    auto begin = std::chrono::high_resolution_clock::now();
+    std::vector<double, recycle_slow> a(array_size, double{});
+    std::vector<double, recycle_slow> b(array_size, double{});
+    std::vector<double, recycle_slow> c(2 * array_size, double{});
+    {
+      std::vector<double, recycle_slow> tmp(4 * array_size, double{});
+    }
+    std::vector<double, recycle_slow> d(4 * array_size, double{});
+    auto end = std::chrono::high_resolution_clock::now();
+    if (step == 0) {
+      first_step_duration =
+          std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+              .count();
+    }
+  }
+  return first_step_duration;
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t array_size = 100000;
+  size_t number_steps = 10;
+  size_t latency = 1000;
+  std::string profile_filename{};
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "arraysize",
+        boost::program_options::value<size_t>(&array_size)
+            ->default_value(100000),
+        "Size of the buffers")(
+        "steps",
+        boost::program_options::value<size_t>(&number_steps)
+            ->default_value(10),
+        "Number of simulated steps per run")(
+        "latency",
+        boost::program_options::value<size_t>(&latency)->default_value(1000),
+        "Simulated latency of each allocation in microseconds")(
+        "profile",
+        boost::program_options::value<std::string>(&profile_filename)
+            ->default_value("allocation_profile_test.txt"),
+        "File used for the allocation profile")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --arraysize = " << array_size << std::endl
+                << " --steps = " << number_steps << std::endl
+                << " --latency = " << latency << std::endl
+                << " --profile = " << profile_filename << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(array_size >= 1);   // NOLINT
+  assert(number_steps >= 1); // NOLINT
+  allocation_latency = std::chrono::microseconds{latency};
+
+  // Cold start: No profile available yet
+  std::remove(profile_filename.c_str());
+  const bool found_profile = recycler::enable_allocation_profile(
+      profile_filename);
+  assert(!found_profile);
+  const size_t cold_duration = run_steps(number_steps, array_size);
+  const size_t working_set = number_allocations;
+  assert(working_set == 4); // tmp gets recycled for d
+  recycler::force_cleanup(); // writes the profile
+  {
+    std::ifstream profile_file(profile_filename);
+    assert(profile_file.good());
+  }
+
+  // Warm start: Preallocate in the background while "setting up"
+  number_allocations = 0;
+  const bool loaded_profile = recycler::enable_allocation_profile(
+      profile_filename);
+  assert(loaded_profile);
+  auto warm_up_fut = std::async(std::launch::async,
+                                []() { recycler::warm_up(recycle_slow{}); });
+  // "Setting up" takes long enough for the warm up to finish
+  warm_up_fut.wait_for(allocation_latency * 100 * working_set);
+  const size_t warm_duration = run_steps(number_steps, array_size);
+  warm_up_fut.get();
+  assert(number_allocations == working_set); // all preallocated
+  recycler::force_cleanup();
+  std::remove(profile_filename.c_str());
+
+  // The profile lists the peak number of buffers in use at once - even if
+  // the unused buffers got cleaned up before it got written
+  recycler::enable_allocation_profile(profile_filename);
+  {
+    std::vector<double, recycle_slow> a(array_size, double{});
+    std::vector<double, recycle_slow> b(array_size, double{});
+  }
+  recycler::cleanup();
+  {
+    std::vector<double, recycle_slow> c(array_size, double{});
+  }
+  recycler::cleanup();
+  recycler::force_cleanup(); // writes the profile
+  {
+    std::ifstream profile_file(profile_filename);
+    const std::string expected_end = " " + std::to_string(array_size) + " 2";
+    std::string line;
+    size_t number_entries = 0;
+    while (std::getline(profile_file, line)) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      number_entries++;
+      assert(line.size() > expected_end.size());
+      assert(line.compare(line.size() - expected_end.size(),
+                          expected_end.size(), expected_end) == 0);
+    }
+    assert(number_entries == 1);
+  }
+  std::remove(profile_filename.c_str());
+
+  std::cout << "==> First step took " << cold_duration << "us (cold start) and "
+            << warm_duration << "us (warm start)" << std::endl;
+  if (warm_duration < cold_duration) {
+    std::cout << "Test information: Warm start was faster than cold start!"
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
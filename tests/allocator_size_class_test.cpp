@@ -0,0 +1,207 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+size_t number_allocations = 0;
+
+template <typename T> struct counting_allocator {
+  using value_type = T;
+  counting_allocator() noexcept = default;
+  template <typename U>
+  explicit counting_allocator(counting_allocator<U> const &) noexcept {}
+  T *allocate(std::size_t n) {
+    number_allocations++;
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) { std::allocator<T>{}.deallocate(p, n); }
+};
+
+/// An element size that does not divide the page size
+struct vector3 {
+  float x, y, z;
+};
+
+/// Rounded sizes are size classes: never smaller than the request, within
+/// max_factor of it and rounding them again does not change them
+template <typename Policy, typename T>
+void check_policy(const size_t max_size, const double max_factor) {
+  size_t previous = 0;
+  for (size_t n = 1; n <= max_size; n++) {
+    const size_t rounded = Policy::template round<T>(n);
+    assert(rounded >= n);
+    assert(static_cast<double>(rounded) <= max_factor * n);
+    assert(Policy::template round<T>(rounded) == rounded);
+    assert(rounded >= previous); // monotonic
+    previous = rounded;
+  }
+  assert(Policy::template round<T>(0) == 0);
+}
+
+/// Simulation steps with continuously varying buffer sizes (e.g. particle
+/// counts). Returns the number of buffers that had to be created
+template <typename Policy>
+size_t run_steps(const size_t number_steps, const size_t array_size) {
+  using allocator_type =
+      recycler::detail::recycle_allocator<double, counting_allocator<double>,
+                                          Policy>;
+  number_allocations = 0;
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<size_t> size_distribution(array_size / 2,
+                                                          array_size);
+  for (size_t step = 0; step < number_steps; step++) {
+    const size_t particles = size_distribution(generator);
+    std::vector<double, allocator_type> positions(particles, 1.0);
+    std::vector<double, allocator_type> velocities(particles, 2.0);
+    // Transparent: The containers see the requested size only
+    assert(positions.size() == particles);
+    assert(positions.capacity() == particles);
+    assert(positions[particles - 1] + velocities[particles - 1] == 3.0);
+  }
+  recycler::force_cleanup();
+  return number_allocations;
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t array_size = 100000;
+  size_t number_steps = 1000;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "arraysize",
+        boost::program_options::value<size_t>(&array_size)
+            ->default_value(100000),
+        "Maximum size of the buffers")(
+        "steps",
+        boost::program_options::value<size_t>(&number_steps)
+            ->default_value(1000),
+        "Number of simulated steps with varying buffer sizes")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --arraysize = " << array_size << std::endl
+                << " --steps = " << number_steps << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(array_size >= 2);   // NOLINT
+  assert(number_steps >= 1); // NOLINT
+
+  // The policies themselves
+  check_policy<recycler::exact_size, double>(10000, 1.0);
+  check_policy<recycler::power_of_two_size, double>(10000, 2.0);
+  check_policy<recycler::geometric_size_5_4, double>(10000, 1.25);
+  check_policy<recycler::geometric_size_9_8, double>(10000, 1.125);
+  check_policy<recycler::page_multiple_size<4096>, double>(10000, 512.0);
+  check_policy<recycler::page_multiple_size<4096>, vector3>(10000, 1024.0);
+  assert(recycler::power_of_two_size::round<double>(1000) == 1024);
+  assert(recycler::geometric_size_5_4::round<double>(1000) == 1024);
+  assert(recycler::geometric_size_5_4::round<double>(1025) == 1280);
+  assert(recycler::geometric_size_9_8::round<double>(1025) == 1152);
+  assert(recycler::page_multiple_size<4096>::round<double>(1) == 512);
+  assert(recycler::page_multiple_size<4096>::round<float>(1025) == 2048);
+  // 3 pages are the smallest whole number of 12 byte elements
+  assert(recycler::page_multiple_size<4096>::round<vector3>(1) == 1024);
+  // No size class above the largest one (and no endless loop)
+  constexpr size_t max_size = std::numeric_limits<size_t>::max();
+  assert(recycler::power_of_two_size::round<char>(max_size) == max_size);
+  assert(recycler::power_of_two_size::round<char>(max_size / 2 + 2) ==
+         max_size / 2 + 2);
+  assert(recycler::power_of_two_size::round<char>(max_size / 2 + 1) ==
+         max_size / 2 + 1);
+  assert(recycler::geometric_size_9_8::round<char>(max_size) == max_size);
+  assert(recycler::page_multiple_size<4096>::round<char>(max_size) ==
+         max_size);
+
+  // Internal fragmentation (see the counters): 1000 -> 1024 floats
+  {
+    std::vector<float, recycler::recycle_std_rounded<
+                           float, recycler::power_of_two_size>>
+        rounded(1000);
+    assert(rounded.size() == 1000);
+  }
+  // Rounded and exact requests of the same class share the buffer
+  {
+    recycler::recycle_std_rounded<float, recycler::power_of_two_size> alloc;
+    float *rounded_buffer = alloc.allocate(1000);
+    alloc.increase_usage_counter(rounded_buffer, 1000); // e.g. Kokkos views
+    alloc.deallocate(rounded_buffer, 1000);
+    alloc.deallocate(rounded_buffer, 1000);
+    float *exact_buffer = recycler::recycle_std<float>{}.allocate(1024);
+    assert(exact_buffer == rounded_buffer);
+    recycler::recycle_std<float>{}.deallocate(exact_buffer, 1024);
+  }
+  // Batches get rounded as well
+  {
+    recycler::aggressive_recycle_std_rounded<double,
+                                             recycler::geometric_size_9_8>
+        alloc;
+    const size_t sizes[3] = {1000, 1001, 1030};
+    double *buffers[3];
+    alloc.allocate_many(sizes, buffers, 3);
+    alloc.deallocate_many(buffers, sizes, 3);
+    double *recycled = alloc.allocate(1020);
+    assert(recycled == buffers[0] || recycled == buffers[1]);
+    alloc.deallocate(recycled, 1020);
+  }
+  recycler::force_cleanup();
+
+  // Continuous sizes: Exact matching hardly ever recycles
+  const size_t exact_creations =
+      run_steps<recycler::exact_size>(number_steps, array_size);
+  const size_t power_of_two_creations =
+      run_steps<recycler::power_of_two_size>(number_steps, array_size);
+  const size_t geometric_creations =
+      run_steps<recycler::geometric_size_9_8>(number_steps, array_size);
+  const size_t page_creations =
+      run_steps<recycler::page_multiple_size<4096>>(number_steps, array_size);
+  std::cout << "==> Created buffers for " << 2 * number_steps
+            << " requests: exact = " << exact_creations
+            << ", power of two = " << power_of_two_creations
+            << ", geometric (9/8) = " << geometric_creations
+            << ", page multiples = " << page_creations << std::endl;
+  assert(power_of_two_creations <= geometric_creations);
+  assert(geometric_creations <= page_creations);
+  assert(page_creations <= exact_creations);
+  if (geometric_creations < exact_creations) {
+    std::cout << "Test information: Size classes raised the recycle rate!"
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef DUMMY_INTERFACE_HPP // NOLINT
+#define DUMMY_INTERFACE_HPP // NOLINT
+
+#include <cstddef>
+
+/// Interface without any functionality - only the pool access gets tested
+class dummy_interface {
+public:
+  explicit dummy_interface(size_t gpu_id = 0) : gpu_id(gpu_id) {}
+  size_t get_gpu_id() const noexcept { return gpu_id; }
+
+private:
+  size_t gpu_id;
+};
+
+#endif
@@ -0,0 +1,187 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <hpx/hpx_init.hpp>
+#include <hpx/include/async.hpp>
+#include <hpx/include/lcos.hpp>
+
+#include <boost/program_options.hpp>
+
+#include "../include/hpx_stream_util.hpp"
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+/// Executes the "device" tasks asynchronously on the host - no GPU required
+class hpx_host_interface {
+public:
+  explicit hpx_host_interface(size_t gpu_id = 0) : gpu_id(gpu_id) {}
+  template <typename F, typename... Ts>
+  decltype(auto) async_execute(F &&f, Ts &&... ts) {
+    return hpx::async(std::forward<F>(f), std::forward<Ts>(ts)...);
+  }
+  size_t get_gpu_id() const noexcept { return gpu_id; }
+
+private:
+  size_t gpu_id;
+};
+
+using pool_type = priority_pool<hpx_host_interface>;
+using dispatcher_type = hybrid_dispatcher<hpx_host_interface, pool_type>;
+
+hpx::future<size_t> dispatch_square(dispatcher_type &dispatcher, size_t i) {
+  return dispatcher.dispatch(
+      [i](hpx_host_interface &interface) {
+        return interface.async_execute([i]() { return i * i; });
+      },
+      [i]() { return i * i; });
+}
+
+int hpx_main(int argc, char *argv[]) {
+
+  size_t number_tasks = 10000;
+  size_t number_streams = 4;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "tasks",
+        boost::program_options::value<size_t>(&number_tasks)
+            ->default_value(10000),
+        "Number of dispatched tasks")(
+        "streams",
+        boost::program_options::value<size_t>(&number_streams)
+            ->default_value(4),
+        "Number of interfaces in the pool")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --tasks = " << number_tasks << std::endl
+                << " --streams = " << number_streams << std::endl
+                << " --hpx:threads = " << hpx::get_os_thread_count()
+                << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return hpx::finalize();
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(number_tasks >= 1);   // NOLINT
+  assert(number_streams >= 1); // NOLINT
+
+  // Hysteresis: stay on the host until the load dropped to the low threshold
+  {
+    stream_pool::init<hpx_host_interface, pool_type>(1);
+    dispatcher_type dispatcher(2, 0);
+    auto first = stream_pool::get_interface<hpx_host_interface, pool_type>();
+    auto second = stream_pool::get_interface<hpx_host_interface, pool_type>();
+    assert(dispatch_square(dispatcher, 2).get() == 4); // load 2 -> host
+    stream_pool::release_interface<hpx_host_interface, pool_type>(
+        std::get<1>(second));
+    assert(dispatch_square(dispatcher, 3).get() == 9); // load 1 -> still host
+    auto statistics = dispatcher.get_statistics();
+    assert(statistics.host_tasks == 2);
+    assert(statistics.device_tasks == 0);
+    stream_pool::release_interface<hpx_host_interface, pool_type>(
+        std::get<1>(first));
+    assert(dispatch_square(dispatcher, 4).get() == 16); // load 0 -> device
+    statistics = dispatcher.get_statistics();
+    assert(statistics.host_tasks == 2);
+    assert(statistics.device_tasks == 1);
+    auto load = stream_pool::get_current_load<hpx_host_interface, pool_type>();
+    assert(load == 0); // released after the task finished
+    stream_pool::cleanup<hpx_host_interface, pool_type>();
+  }
+
+  // Weighted tasks count with their weight - and their futures may outlive
+  // the dispatcher
+  {
+    stream_pool::init<hpx_host_interface, pool_type>(1);
+    hpx::lcos::local::promise<void> gate;
+    hpx::shared_future<void> opened = gate.get_future();
+    hpx::future<size_t> fut;
+    {
+      dispatcher_type dispatcher(4, 0);
+      fut = dispatcher.dispatch(
+          [opened](hpx_host_interface &interface) {
+            return interface.async_execute([opened]() {
+              opened.get();
+              return size_t{25};
+            });
+          },
+          []() { return size_t{25}; }, 3);
+      auto load =
+          stream_pool::get_current_load<hpx_host_interface, pool_type>();
+      assert(load == 3); // offloaded with weight 3
+      assert(dispatch_square(dispatcher, 6).get() == 36); // 3 < 4 -> device
+    }
+    gate.set_value();
+    assert(fut.get() == 25);
+    auto load = stream_pool::get_current_load<hpx_host_interface, pool_type>();
+    assert(load == 0);
+    stream_pool::cleanup<hpx_host_interface, pool_type>();
+  }
+
+  // Many tasks: the results do not depend on the side they ran on
+  {
+    stream_pool::init<hpx_host_interface, pool_type>(number_streams);
+    dispatcher_type dispatcher(2, 1);
+    std::vector<hpx::future<size_t>> futs;
+    futs.reserve(number_tasks);
+    for (size_t i = 0; i < number_tasks; i++) {
+      futs.push_back(dispatch_square(dispatcher, i));
+    }
+    for (size_t i = 0; i < number_tasks; i++) {
+      assert(futs[i].get() == i * i);
+    }
+    const auto statistics = dispatcher.get_statistics();
+    assert(statistics.device_tasks + statistics.host_tasks == number_tasks);
+    auto load = stream_pool::get_current_load<hpx_host_interface, pool_type>();
+    assert(load == 0);
+    stream_pool::cleanup<hpx_host_interface, pool_type>();
+    std::cout << "==> " << statistics.device_tasks
+              << " tasks ran on the interfaces (average latency "
+              << (statistics.device_tasks > 0
+                      ? statistics.device_latency_us / statistics.device_tasks
+                      : 0)
+              << "us), " << statistics.host_tasks
+              << " tasks ran on the host (average latency "
+              << (statistics.host_tasks > 0
+                      ? statistics.host_latency_us / statistics.host_tasks
+                      : 0)
+              << "us)" << std::endl;
+  }
+  std::cout << "Test information: Hybrid dispatcher results are correct!"
+            << std::endl;
+  return hpx::finalize();
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> cfg = {"hpx.commandline.allow_unknown=1"};
+  return hpx::init(argc, argv, cfg);
+}
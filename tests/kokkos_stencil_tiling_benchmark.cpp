@@ -0,0 +1,167 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <hpx/hpx_init.hpp>
+#include <hpx/include/async.hpp>
+#include <hpx/include/lcos.hpp>
+
+#include <hpx/kokkos.hpp>
+
+#include <Kokkos_Core.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "../include/buffer_manager.hpp"
+#include "../include/kokkos_buffer_util.hpp"
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+template <class T>
+using kokkos_um_array =
+    Kokkos::View<T ***, Kokkos::HostSpace, Kokkos::MemoryUnmanaged>;
+template <class T>
+using recycled_host_view =
+    recycler::recycled_view<kokkos_um_array<T>, recycler::recycle_std<T>, T>;
+
+/// Runs a 7-point stencil with the given policy and returns the runtime in ms
+template <typename Executor, typename Policy>
+size_t run_stencil(Executor &executor, const Policy &policy,
+                   const recycled_host_view<double> &input,
+                   const recycled_host_view<double> &output,
+                   const size_t passes) {
+  const int64_t n0 = input.extent(0);
+  const int64_t n1 = input.extent(1);
+  const int64_t n2 = input.extent(2);
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (size_t pass = 0; pass < passes; pass++) {
+    Kokkos::parallel_for(
+        "stencil", policy, KOKKOS_LAMBDA(int i, int j, int k) {
+          if (i == 0 || j == 0 || k == 0 || i == n0 - 1 || j == n1 - 1 ||
+              k == n2 - 1) {
+            output(i, j, k) = input(i, j, k);
+            return;
+          }
+          output(i, j, k) =
+              (input(i - 1, j, k) + input(i + 1, j, k) + input(i, j - 1, k) +
+               input(i, j + 1, k) + input(i, j, k - 1) + input(i, j, k + 1)) /
+              6.0;
+        });
+    executor.instance().fence();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(end - begin)
+      .count();
+}
+
+template <typename Executor>
+void benchmark_tiling(const std::string &space_name, const size_t extent,
+                      const size_t passes) {
+  Executor executor;
+  recycled_host_view<double> input(extent, extent, extent);
+  recycled_host_view<double> output(extent, extent, extent);
+  Kokkos::parallel_for(
+      "stencil init", get_iteration_policy(executor.instance(), input),
+      KOKKOS_LAMBDA(int i, int j, int k) {
+        input(i, j, k) = static_cast<double>(i + j + k);
+      });
+  executor.instance().fence();
+
+  const auto tiling =
+      recycler::detail::get_cache_aware_tiling(input, {0, 0, 0});
+  std::cout << "\n" << space_name << ": automatic tiling " << tiling[0] << "x"
+            << tiling[1] << "x" << tiling[2] << std::endl;
+
+  const size_t default_duration =
+      run_stencil(executor, get_iteration_policy(executor.instance(), output),
+                  input, output, passes);
+  const double checksum = output(extent / 2, extent / 2, extent / 2);
+  const size_t tiled_duration = run_stencil(
+      executor,
+      get_iteration_policy(executor.instance(), output,
+                           Kokkos::Array<int64_t, 3>{0, 0, 0}),
+      input, output, passes);
+  assert(output(extent / 2, extent / 2, extent / 2) == checksum);
+
+  std::cout << "==> " << space_name << " stencil with default tiling took "
+            << default_duration << "ms" << std::endl
+            << "==> " << space_name << " stencil with cache-aware tiling took "
+            << tiled_duration << "ms" << std::endl;
+  if (tiled_duration < default_duration) {
+    std::cout << "Test information: Cache-aware tiling was faster than the "
+                 "default tiling on "
+              << space_name << "!" << std::endl;
+  }
+}
+
+int hpx_main(int argc, char *argv[]) {
+  size_t extent = 128;
+  size_t passes = 50;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "extent",
+        boost::program_options::value<size_t>(&extent)->default_value(128),
+        "Extent of each dimension of the stencil views")(
+        "passes",
+        boost::program_options::value<size_t>(&passes)->default_value(50),
+        "Sets the number of repetitions")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --extent = " << extent << std::endl
+                << " --passes = " << passes << std::endl
+                << " --hpx:threads = " << hpx::get_os_thread_count()
+                << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return hpx::finalize();
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(extent >= 3); // NOLINT
+  assert(passes >= 1); // NOLINT
+
+  hpx::kokkos::ScopeGuard g(argc, argv);
+  const auto caches = recycler::detail::get_cache_sizes();
+  std::cout << "Detected caches: L1d " << caches.l1_data << " bytes, L2 "
+            << caches.l2 << " bytes" << std::endl;
+
+#if defined(KOKKOS_ENABLE_HPX)
+  benchmark_tiling<hpx::kokkos::hpx_executor>("HPX", extent, passes);
+#endif
+#if defined(KOKKOS_ENABLE_OPENMP)
+  benchmark_tiling<hpx::kokkos::openmp_executor>("OpenMP", extent, passes);
+#endif
+
+  recycler::force_cleanup();
+  return hpx::finalize();
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> cfg = {"hpx.commandline.allow_unknown=1"};
+  return hpx::init(argc, argv, cfg);
+}
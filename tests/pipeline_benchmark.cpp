@@ -0,0 +1,164 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include "../include/host_stream_executor.hpp"
+#include "../include/pipeline_util.hpp"
+#include "../include/stream_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+using executor_type = recycler::host_stream_executor<>;
+using pool_type = priority_pool<executor_type>;
+
+/// Squares input into output through the chunked pipeline. Each stage gets
+/// delayed by the simulated latency of the executor. Returns the runtime in
+/// microseconds.
+size_t run_pipeline(const std::vector<double> &input,
+                    std::vector<double> &output, const size_t chunk_size,
+                    const size_t depth) {
+  auto begin = std::chrono::high_resolution_clock::now();
+  auto fut = recycler::launch_chunked_pipeline<executor_type, pool_type,
+                                               double>(
+      input.size(), chunk_size, depth,
+      [&input](executor_type &interface, double *chunk, size_t offset,
+               size_t number_elements) {
+        interface.post([&input, chunk, offset, number_elements]() {
+          std::memcpy(chunk, input.data() + offset,
+                      number_elements * sizeof(double));
+        });
+      },
+      [](executor_type &interface, double *chunk, size_t /*offset*/,
+         size_t number_elements) {
+        interface.post([chunk, number_elements]() {
+          for (size_t i = 0; i < number_elements; i++) {
+            chunk[i] = chunk[i] * chunk[i];
+          }
+        });
+      },
+      [&output](executor_type &interface, double *chunk, size_t offset,
+                size_t number_elements) {
+        interface.post([&output, chunk, offset, number_elements]() {
+          std::memcpy(output.data() + offset, chunk,
+                      number_elements * sizeof(double));
+        });
+      });
+  fut.get();
+  auto end = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < input.size(); i++) {
+    assert(output[i] == input[i] * input[i]);
+  }
+  auto load = stream_pool::get_current_load<executor_type, pool_type>();
+  assert(load == 0); // all interfaces got released
+  return std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+      .count();
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t number_elements = 1 << 20;
+  size_t chunk_size = 1 << 15;
+  size_t depth = 3;
+  size_t stage_latency = 200;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "elements",
+        boost::program_options::value<size_t>(&number_elements)
+            ->default_value(1 << 20),
+        "Number of elements streamed through the pipeline")(
+        "chunk_size",
+        boost::program_options::value<size_t>(&chunk_size)
+            ->default_value(1 << 15),
+        "Number of elements per chunk")(
+        "depth",
+        boost::program_options::value<size_t>(&depth)->default_value(3),
+        "Number of chunks in flight")(
+        "latency",
+        boost::program_options::value<size_t>(&stage_latency)
+            ->default_value(200),
+        "Simulated latency of each stage in microseconds")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --elements = " << number_elements << std::endl
+                << " --chunk_size = " << chunk_size << std::endl
+                << " --depth = " << depth << std::endl
+                << " --latency = " << stage_latency << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(number_elements >= 1); // NOLINT
+  assert(chunk_size >= 1);      // NOLINT
+  assert(depth >= 2);           // NOLINT
+
+  std::vector<double> input(number_elements);
+  std::vector<double> output(number_elements);
+  for (size_t i = 0; i < number_elements; i++) {
+    input[i] = static_cast<double>(i % 1000);
+  }
+
+  // one interface per chunk in flight
+  stream_pool::init<executor_type, pool_type>(
+      depth, 0, std::chrono::microseconds{stage_latency});
+  // Correctness with a last chunk that is not full
+  {
+    std::vector<double> small_input(1001, 3.0);
+    std::vector<double> small_output(1001);
+    run_pipeline(small_input, small_output, 100, depth);
+  }
+
+  const size_t serial_duration = run_pipeline(input, output, chunk_size, 1);
+  std::fill(output.begin(), output.end(), 0.0);
+  const size_t pipelined_duration =
+      run_pipeline(input, output, chunk_size, depth);
+  stream_pool::cleanup<executor_type, pool_type>();
+
+  const double speedup = static_cast<double>(serial_duration) /
+                         static_cast<double>(pipelined_duration);
+  std::cout << "==> Depth 1 took " << serial_duration << "us, depth " << depth
+            << " took " << pipelined_duration << "us" << std::endl;
+  std::cout << "==> Speedup: " << speedup
+            << ", overlap efficiency: " << 100.0 * speedup / depth << "%"
+            << std::endl;
+  if (pipelined_duration < serial_duration) {
+    std::cout << "Test information: Pipelined chunks were faster than "
+                 "serialized chunks!"
+              << std::endl;
+  }
+  recycler::force_cleanup();
+  return EXIT_SUCCESS;
+}
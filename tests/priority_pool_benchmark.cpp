@@ -0,0 +1,161 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/stream_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+#include "dummy_interface.hpp"
+
+/// Previous priority_pool implementation (rebuilds the heap on every call) for
+/// comparison
+template <class Interface> class make_heap_priority_pool {
+private:
+  std::vector<Interface> pool{};
+  std::vector<size_t> ref_counters{};
+  std::vector<size_t> priorities{};
+
+public:
+  explicit make_heap_priority_pool(size_t number_of_streams) {
+    for (size_t i = 0; i < number_of_streams; i++) {
+      pool.emplace_back();
+      ref_counters.emplace_back(0);
+      priorities.emplace_back(i);
+    }
+  }
+  std::tuple<Interface &, size_t> get_interface() {
+    auto &interface = pool[priorities[0]];
+    ref_counters[priorities[0]]++;
+    std::tuple<Interface &, size_t> ret(interface, priorities[0]);
+    std::make_heap(std::begin(priorities), std::end(priorities),
+                   [this](const size_t &first, const size_t &second) -> bool {
+                     return ref_counters[first] > ref_counters[second];
+                   });
+    return ret;
+  }
+  void release_interface(size_t index) {
+    ref_counters[index]--;
+    std::make_heap(std::begin(priorities), std::end(priorities),
+                   [this](const size_t &first, const size_t &second) -> bool {
+                     return ref_counters[first] > ref_counters[second];
+                   });
+  }
+  size_t get_current_load() { return ref_counters[priorities[0]]; }
+};
+
+/// Keeps load_factor tasks per stream in flight and measures the average time
+/// of one release + acquire pair in nanoseconds
+template <typename Pool>
+double benchmark_pool(const size_t number_streams, const size_t load_factor,
+                      const size_t passes) {
+  Pool pool(number_streams);
+  const size_t in_flight = number_streams * load_factor;
+  std::vector<size_t> indices(in_flight);
+  for (auto &index : indices) {
+    index = std::get<1>(pool.get_interface());
+  }
+  // The least loaded stream always has to be picked
+  assert(pool.get_current_load() == load_factor);
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (size_t pass = 0; pass < passes; pass++) {
+    auto &index = indices[pass % in_flight];
+    pool.release_interface(index);
+    index = std::get<1>(pool.get_interface());
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  assert(pool.get_current_load() == load_factor);
+  for (auto index : indices) {
+    pool.release_interface(index);
+  }
+  assert(pool.get_current_load() == 0);
+  return static_cast<double>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+                 .count()) /
+         passes;
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t max_streams = 128;
+  size_t load_factor = 4;
+  size_t passes = 1000000;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "max_streams",
+        boost::program_options::value<size_t>(&max_streams)
+            ->default_value(128),
+        "Maximum number of streams (doubled from 1 up to this value)")(
+        "load_factor",
+        boost::program_options::value<size_t>(&load_factor)->default_value(4),
+        "Number of tasks in flight per stream")(
+        "passes",
+        boost::program_options::value<size_t>(&passes)->default_value(1000000),
+        "Sets the number of release/acquire pairs")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --max_streams = " << max_streams << std::endl
+                << " --load_factor = " << load_factor << std::endl
+                << " --passes = " << passes << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(passes >= 1);      // NOLINT
+  assert(max_streams >= 1); // NOLINT
+  assert(load_factor >= 1); // NOLINT
+
+  double heap_latency_at_max = 0.0;
+  double make_heap_latency_at_max = 0.0;
+  for (size_t number_streams = 1; number_streams <= max_streams;
+       number_streams *= 2) {
+    heap_latency_at_max = benchmark_pool<priority_pool<dummy_interface>>(
+        number_streams, load_factor, passes);
+    make_heap_latency_at_max =
+        benchmark_pool<make_heap_priority_pool<dummy_interface>>(
+            number_streams, load_factor, passes);
+    std::cout << "==> " << number_streams
+              << " streams: indexed heap release+acquire took "
+              << heap_latency_at_max << "ns, make_heap took "
+              << make_heap_latency_at_max << "ns" << std::endl;
+  }
+
+  if (heap_latency_at_max < make_heap_latency_at_max) {
+    std::cout << "Test information: Indexed heap was faster than make_heap!"
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
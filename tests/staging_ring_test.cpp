@@ -0,0 +1,163 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/buffer_manager.hpp"
+#include "../include/host_stream_executor.hpp"
+#include "../include/staging_buffer_util.hpp"
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+using executor_type = recycler::host_stream_executor<>;
+
+/// Host memcpy on the (simulated) stream as the asynchronous copy
+auto make_async_copy(executor_type &executor) {
+  return [&executor](void *destination, const void *source, size_t bytes) {
+    return executor.async_execute(
+        [destination, source, bytes]() {
+          std::memcpy(destination, source, bytes);
+        });
+  };
+}
+
+/// Copies the data there and back again through a staging ring. Returns the
+/// runtime in microseconds.
+size_t run_transfers(const size_t number_slots, const size_t slot_size,
+                     const size_t bytes, const size_t passes,
+                     const std::chrono::microseconds copy_latency) {
+  executor_type executor(0, copy_latency);
+  recycler::staging_ring_std ring(slot_size, number_slots);
+  std::vector<char> pageable_source(bytes);
+  std::vector<char> pageable_result(bytes);
+  std::vector<char> destination(bytes); // stands in for the device memory
+  for (size_t i = 0; i < bytes; i++) {
+    pageable_source[i] = static_cast<char>(i % 127);
+  }
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (size_t pass = 0; pass < passes; pass++) {
+    ring.copy_to(destination.data(), pageable_source.data(), bytes,
+                 make_async_copy(executor));
+    ring.copy_from(pageable_result.data(), destination.data(), bytes,
+                   make_async_copy(executor));
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  assert(destination == pageable_source);
+  assert(pageable_result == pageable_source);
+  return std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+      .count();
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t slot_size = 1 << 20;
+  size_t number_slots = 4;
+  size_t bytes = 32 << 20;
+  size_t passes = 4;
+  size_t copy_latency = 100;
+  size_t repeats = 3;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "slot_size",
+        boost::program_options::value<size_t>(&slot_size)
+            ->default_value(1 << 20),
+        "Size of each staging slot in bytes")(
+        "slots",
+        boost::program_options::value<size_t>(&number_slots)->default_value(4),
+        "Number of staging slots")(
+        "bytes",
+        boost::program_options::value<size_t>(&bytes)->default_value(32 << 20),
+        "Size of the transfers in bytes")(
+        "passes",
+        boost::program_options::value<size_t>(&passes)->default_value(4),
+        "Sets the number of repetitions")(
+        "latency",
+        boost::program_options::value<size_t>(&copy_latency)
+            ->default_value(100),
+        "Simulated latency of each asynchronous copy in microseconds")(
+        "repeats",
+        boost::program_options::value<size_t>(&repeats)->default_value(3),
+        "Number of measurements - the fastest one of each variant counts")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --slot_size = " << slot_size << std::endl
+                << " --slots = " << number_slots << std::endl
+                << " --bytes = " << bytes << std::endl
+                << " --passes = " << passes << std::endl
+                << " --latency = " << copy_latency << std::endl
+                << " --repeats = " << repeats << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(slot_size >= 1);    // NOLINT
+  assert(number_slots >= 1); // NOLINT
+  assert(bytes >= 1);        // NOLINT
+  assert(passes >= 1);       // NOLINT
+  assert(repeats >= 1);      // NOLINT
+
+  // Correctness with transfers that do not fill the last slot
+  run_transfers(3, 1000, 1, 1, std::chrono::microseconds{0});
+  run_transfers(3, 1000, 10007, 1, std::chrono::microseconds{0});
+  run_transfers(1, 64, 10007, 1, std::chrono::microseconds{0});
+
+  // Alternating measurements, so that noise affects both variants alike
+  size_t single_slot_duration = std::numeric_limits<size_t>::max();
+  size_t ring_duration = std::numeric_limits<size_t>::max();
+  for (size_t repeat = 0; repeat < repeats; repeat++) {
+    single_slot_duration = std::min(
+        single_slot_duration,
+        run_transfers(1, slot_size, bytes, passes,
+                      std::chrono::microseconds{copy_latency}));
+    ring_duration =
+        std::min(ring_duration,
+                 run_transfers(number_slots, slot_size, bytes, passes,
+                               std::chrono::microseconds{copy_latency}));
+  }
+  std::cout << "==> Staging through one slot took " << single_slot_duration
+            << "us" << std::endl;
+  std::cout << "==> Staging through " << number_slots << " slots took "
+            << ring_duration << "us" << std::endl;
+
+  if (ring_duration < single_slot_duration) {
+    std::cout << "Test information: Pipelined staging was faster than a "
+                 "single staging slot!"
+              << std::endl;
+  }
+  recycler::force_cleanup();
+  return EXIT_SUCCESS;
+}
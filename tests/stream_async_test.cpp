@@ -0,0 +1,156 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <hpx/hpx_init.hpp>
+#include <hpx/include/async.hpp>
+#include <hpx/include/lcos.hpp>
+
+#include <boost/program_options.hpp>
+
+#include "../include/hpx_stream_util.hpp"
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+#include "dummy_interface.hpp"
+
+using pool_type = priority_pool<dummy_interface>;
+
+int hpx_main(int argc, char *argv[]) {
+
+  size_t number_futures = 256;
+  size_t number_streams = 4;
+  size_t load_limit = 2;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "futures",
+        boost::program_options::value<size_t>(&number_futures)
+            ->default_value(256),
+        "Number of tasks waiting for an interface")(
+        "streams",
+        boost::program_options::value<size_t>(&number_streams)
+            ->default_value(4),
+        "Number of interfaces in the pool")(
+        "load_limit",
+        boost::program_options::value<size_t>(&load_limit)->default_value(2),
+        "Maximum number of tasks per interface")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --futures = " << number_futures << std::endl
+                << " --streams = " << number_streams << std::endl
+                << " --load_limit = " << load_limit << std::endl
+                << " --hpx:threads = " << hpx::get_os_thread_count()
+                << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return hpx::finalize();
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(number_futures >= 1); // NOLINT
+  assert(number_streams >= 1); // NOLINT
+  assert(load_limit >= 1);     // NOLINT
+
+  stream_pool::init<dummy_interface, pool_type>(number_streams);
+
+  // Unavailable interface -> the future only becomes ready after a release
+  {
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < number_streams * load_limit; i++) {
+      auto interface = stream_pool::get_interface<dummy_interface, pool_type>();
+      indices.push_back(std::get<1>(interface));
+    }
+    auto handle_future =
+        get_interface_async<dummy_interface, pool_type>(load_limit);
+    assert(!handle_future.is_ready());
+    stream_pool::release_interface<dummy_interface, pool_type>(indices.back());
+    indices.pop_back();
+    assert(handle_future.is_ready());
+    auto handle = handle_future.get();
+    // the handle should release its interface once moved into a new scope
+    { auto moved_handle = std::move(handle); }
+    for (auto index : indices) {
+      stream_pool::release_interface<dummy_interface, pool_type>(index);
+    }
+    auto load = stream_pool::get_current_load<dummy_interface, pool_type>();
+    assert(load == 0);
+  }
+
+  // Many tasks throttled by the load limit
+  {
+    std::atomic<size_t> max_observed_load{0};
+    auto begin = std::chrono::high_resolution_clock::now();
+    std::vector<hpx::future<void>> futs;
+    futs.reserve(number_futures);
+    for (size_t i = 0; i < number_futures; i++) {
+      futs.push_back(
+          get_interface_async<dummy_interface, pool_type>(load_limit)
+              .then([&max_observed_load](
+                        hpx::future<stream_pool_handle<dummy_interface,
+                                                       pool_type>> &&fut) {
+                auto handle = fut.get();
+                size_t load =
+                    stream_pool::get_current_load<dummy_interface, pool_type>();
+                size_t observed = max_observed_load;
+                while (load > observed &&
+                       !max_observed_load.compare_exchange_weak(observed,
+                                                                load)) {
+                }
+              }));
+    }
+    hpx::wait_all(futs);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto load = stream_pool::get_current_load<dummy_interface, pool_type>();
+    assert(load == 0);
+    size_t waiting =
+        stream_pool::get_number_waiting_requests<dummy_interface, pool_type>();
+    assert(waiting == 0);
+    // the minimum load never exceeds the limit
+    assert(max_observed_load <= load_limit);
+    std::cout << "==> " << number_futures
+              << " asynchronous acquisitions took "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                       begin)
+                     .count()
+              << "us" << std::endl;
+  }
+  stream_pool::cleanup<dummy_interface, pool_type>();
+  std::cout << "Test information: All asynchronous acquisitions got served!"
+            << std::endl;
+  return hpx::finalize();
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> cfg = {"hpx.commandline.allow_unknown=1"};
+  return hpx::init(argc, argv, cfg);
+}
@@ -0,0 +1,299 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/host_stream_executor.hpp"
+#include "../include/stream_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+#include "stream_test.hpp"
+
+using executor_type = recycler::host_stream_executor<>;
+
+/// Tasks submitted to one interface have to be executed in order
+template <typename Pool, typename... Ts>
+void test_pool_in_order_execution(const size_t stream_parameter,
+                                  Ts &&... ts) {
+  stream_pool::init<executor_type, Pool>(stream_parameter,
+                                         std::forward<Ts>(ts)...);
+  {
+    stream_interface<executor_type, Pool> interface;
+    std::vector<size_t> results;
+    for (size_t i = 0; i < 100; i++) {
+      interface.post([&results, i]() { results.push_back(i); });
+    }
+    auto fut = interface.async_execute(
+        [&results]() -> size_t { return results.size(); });
+    assert(fut.get() == 100);
+    for (size_t i = 0; i < 100; i++) {
+      assert(results[i] == i);
+    }
+    // exceptions end up in the future
+    auto failing_fut = interface.async_execute(
+        []() -> int { throw std::runtime_error("test"); });
+    bool caught = false;
+    try {
+      failing_fut.get();
+    } catch (const std::runtime_error &) {
+      caught = true;
+    }
+    assert(caught);
+  }
+  stream_pool::cleanup<executor_type, Pool>();
+}
+
+/// Many small posts onto one interface: coalescing should keep the order
+/// and reduce the per-submission overhead. Returns the runtime of the
+/// coalesced and the plain submissions in microseconds.
+std::tuple<size_t, size_t> benchmark_coalescing(const size_t number_posts,
+                                                const size_t max_batch_size) {
+  using pool_type =
+      named_pool<round_robin_pool<executor_type>, struct coalescing_tag>;
+  // simulate a dispatch overhead per submission
+  stream_pool::init<executor_type, pool_type>(1, 0,
+                                              std::chrono::microseconds{5});
+  std::vector<size_t> results;
+  results.reserve(2 * number_posts);
+  auto begin = std::chrono::high_resolution_clock::now();
+  {
+    coalescing_stream_interface<executor_type, pool_type> interface(
+        max_batch_size);
+    for (size_t i = 0; i < number_posts; i++) {
+      interface.post([&results](size_t value) { results.push_back(value); },
+                     i);
+    }
+    // the future covers all buffered posts
+    auto fut = interface.async_execute(
+        [&results]() -> size_t { return results.size(); });
+    assert(fut.get() == number_posts);
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  const size_t coalesced_duration =
+      std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+          .count();
+  for (size_t i = 0; i < number_posts; i++) {
+    assert(results[i] == i); // in-order
+  }
+
+  begin = std::chrono::high_resolution_clock::now();
+  {
+    stream_interface<executor_type, pool_type> interface;
+    for (size_t i = 0; i < number_posts; i++) {
+      interface.post([&results](size_t value) { results.push_back(value); },
+                     number_posts + i);
+    }
+    auto fut = interface.async_execute(
+        [&results]() -> size_t { return results.size(); });
+    assert(fut.get() == 2 * number_posts);
+  }
+  end = std::chrono::high_resolution_clock::now();
+  const size_t single_duration =
+      std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+          .count();
+  stream_pool::cleanup<executor_type, pool_type>();
+  std::cout << "==> " << number_posts << " coalesced posts took "
+            << coalesced_duration << "us, single posts took "
+            << single_duration << "us" << std::endl;
+  return std::make_tuple(coalesced_duration, single_duration);
+}
+
+/// Submits tasks from number_threads threads, each through its own
+/// stream_interface. Returns the number of tasks per millisecond.
+template <typename Pool, typename... Ts>
+double benchmark_pool_throughput(const std::string &pool_name,
+                                 const size_t number_threads,
+                                 const size_t number_tasks,
+                                 const size_t stream_parameter, Ts &&... ts) {
+  stream_pool::init<executor_type, Pool>(stream_parameter,
+                                         std::forward<Ts>(ts)...);
+  std::atomic<size_t> executed_tasks{0};
+  std::vector<std::thread> threads;
+  threads.reserve(number_threads);
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (size_t thread_id = 0; thread_id < number_threads; thread_id++) {
+    threads.emplace_back([number_tasks, &executed_tasks]() {
+      std::vector<std::future<void>> futs;
+      futs.reserve(number_tasks);
+      for (size_t task = 0; task < number_tasks; task++) {
+        stream_interface<executor_type, Pool> interface;
+        futs.push_back(
+            interface.async_execute([&executed_tasks]() { executed_tasks++; }));
+      }
+      for (auto &fut : futs) {
+        fut.get();
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  assert(executed_tasks == number_threads * number_tasks);
+  auto load = stream_pool::get_current_load<executor_type, Pool>();
+  assert(load == 0);
+  stream_pool::cleanup<executor_type, Pool>();
+  const double duration_ms =
+      static_cast<double>(
+          std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+              .count()) /
+      1000.0;
+  const double throughput =
+      static_cast<double>(number_threads * number_tasks) / duration_ms;
+  std::cout << "==> " << pool_name << ": " << throughput << " tasks/ms"
+            << std::endl;
+  return throughput;
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t number_threads = 4;
+  size_t number_tasks = 10000;
+  size_t number_streams = 4;
+  size_t number_posts = 2000;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "threads",
+        boost::program_options::value<size_t>(&number_threads)
+            ->default_value(4),
+        "Number of threads submitting tasks in the benchmarks")(
+        "tasks",
+        boost::program_options::value<size_t>(&number_tasks)
+            ->default_value(10000),
+        "Number of tasks per thread in the benchmarks")(
+        "streams",
+        boost::program_options::value<size_t>(&number_streams)
+            ->default_value(4),
+        "Number of interfaces (per GPU) in the benchmarks")(
+        "posts",
+        boost::program_options::value<size_t>(&number_posts)
+            ->default_value(2000),
+        "Number of small posts in the coalescing benchmark")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --threads = " << number_threads << std::endl
+                << " --tasks = " << number_tasks << std::endl
+                << " --streams = " << number_streams << std::endl
+                << " --posts = " << number_posts << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(number_threads >= 1); // NOLINT
+  assert(number_tasks >= 1);   // NOLINT
+  assert(number_streams >= 1); // NOLINT
+  assert(number_posts >= 1);   // NOLINT
+
+  std::cout << "Starting ref counting tests ..." << std::endl;
+  test_pool_ref_counting<executor_type, priority_pool<executor_type>>(2, 0);
+  test_pool_ref_counting<executor_type, round_robin_pool<executor_type>>(2,
+                                                                         0);
+  test_pool_ref_counting<
+      executor_type,
+      multi_gpu_round_robin_pool<executor_type,
+                                 round_robin_pool<executor_type>>>(2, 1);
+  test_pool_ref_counting<
+      executor_type,
+      priority_pool_multi_gpu<executor_type, priority_pool<executor_type>>>(2,
+                                                                           1);
+  test_pool_ref_counting<
+      executor_type,
+      multi_gpu_round_robin_pool<executor_type, priority_pool<executor_type>>>(
+      2, 1);
+  test_pool_ref_counting<
+      executor_type,
+      priority_pool_multi_gpu<executor_type, round_robin_pool<executor_type>>>(
+      2, 1);
+  std::cout << "Finished ref counting tests!" << std::endl;
+
+  std::cout << "Starting wrapper objects tests ..." << std::endl;
+  test_pool_wrappers<executor_type, priority_pool<executor_type>>(2, 0);
+  test_pool_wrappers<executor_type, round_robin_pool<executor_type>>(2, 0);
+  test_pool_wrappers<
+      executor_type,
+      multi_gpu_round_robin_pool<executor_type,
+                                 round_robin_pool<executor_type>>>(2, 1);
+  test_pool_wrappers<
+      executor_type,
+      priority_pool_multi_gpu<executor_type, priority_pool<executor_type>>>(2,
+                                                                           1);
+  test_pool_wrappers<
+      executor_type,
+      multi_gpu_round_robin_pool<executor_type, priority_pool<executor_type>>>(
+      2, 1);
+  test_pool_wrappers<
+      executor_type,
+      priority_pool_multi_gpu<executor_type, round_robin_pool<executor_type>>>(
+      2, 1);
+  std::cout << "Finished wrapper objects tests!" << std::endl;
+
+  std::cout << "Starting in-order execution tests ..." << std::endl;
+  test_pool_in_order_execution<round_robin_pool<executor_type>>(2, 0);
+  test_pool_in_order_execution<priority_pool<executor_type>>(2, 0);
+  test_pool_in_order_execution<multi_gpu_round_robin_pool<
+      executor_type, round_robin_pool<executor_type>>>(2, 2);
+  test_pool_in_order_execution<
+      priority_pool_multi_gpu<executor_type, priority_pool<executor_type>>>(2,
+                                                                           2);
+  std::cout << "Finished in-order execution tests!" << std::endl;
+
+  std::cout << "Starting throughput benchmarks ..." << std::endl;
+  benchmark_pool_throughput<round_robin_pool<executor_type>>(
+      "round_robin_pool", number_threads, number_tasks, number_streams, 0);
+  benchmark_pool_throughput<priority_pool<executor_type>>(
+      "priority_pool", number_threads, number_tasks, number_streams, 0);
+  benchmark_pool_throughput<multi_gpu_round_robin_pool<
+      executor_type, round_robin_pool<executor_type>>>(
+      "multi_gpu_round_robin_pool", number_threads, number_tasks,
+      number_streams, 2);
+  benchmark_pool_throughput<
+      priority_pool_multi_gpu<executor_type, priority_pool<executor_type>>>(
+      "priority_pool_multi_gpu", number_threads, number_tasks, number_streams,
+      2);
+  std::cout << "Finished throughput benchmarks!" << std::endl;
+
+  std::cout << "Starting coalescing benchmark ..." << std::endl;
+  const auto coalescing_durations = benchmark_coalescing(number_posts, 64);
+  if (std::get<0>(coalescing_durations) < std::get<1>(coalescing_durations)) {
+    std::cout << "Test information: Coalesced posts were faster than single "
+                 "posts!"
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,476 @@
+// Copyright (c) 2020-2021 Gregor Daiß
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/stream_manager.hpp"
+#include <boost/program_options.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Assert during Release builds as well for this file:
+#undef NDEBUG
+#include <cassert> // reinclude the header to update the definition of assert()
+
+#include "dummy_interface.hpp"
+
+/// Hammers the pool from number_threads threads and checks that all
+/// references are released afterwards. Returns the runtime in microseconds.
+template <typename Pool, typename... Ts>
+size_t test_pool_concurrency(const std::string &pool_name,
+                             const size_t number_threads, const size_t passes,
+                             const size_t number_streams,
+                             const size_t number_interfaces, Ts &&... ts) {
+  stream_pool::init<dummy_interface, Pool>(number_streams,
+                                           std::forward<Ts>(ts)...);
+  std::vector<std::thread> threads;
+  threads.reserve(number_threads);
+  auto begin = std::chrono::high_resolution_clock::now();
+  for (size_t thread_id = 0; thread_id < number_threads; thread_id++) {
+    threads.emplace_back([passes]() {
+      for (size_t pass = 0; pass < passes; pass++) {
+        auto interface = stream_pool::get_interface<dummy_interface, Pool>();
+        if (stream_pool::interface_available<dummy_interface, Pool>(1)) {
+          (void)stream_pool::get_current_load<dummy_interface, Pool>();
+        }
+        stream_pool::release_interface<dummy_interface, Pool>(
+            std::get<1>(interface));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  auto load = stream_pool::get_current_load<dummy_interface, Pool>();
+  assert(load == 0);
+  // use all interfaces once more: all of them need to be released
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < number_interfaces; i++) {
+    indices.push_back(
+        std::get<1>(stream_pool::get_interface<dummy_interface, Pool>()));
+  }
+  load = stream_pool::get_current_load<dummy_interface, Pool>();
+  assert(load == 1);
+  for (auto index : indices) {
+    stream_pool::release_interface<dummy_interface, Pool>(index);
+  }
+  load = stream_pool::get_current_load<dummy_interface, Pool>();
+  assert(load == 0);
+  stream_pool::cleanup<dummy_interface, Pool>();
+
+  const size_t duration =
+      std::chrono::duration_cast<std::chrono::microseconds>(end - begin)
+          .count();
+  std::cout << "==> " << pool_name << " with " << number_threads
+            << " threads took " << duration << "us" << std::endl;
+  return duration;
+}
+
+/// Numbers the threads in the order of their first call (instead of the CPU
+/// they run on), so that two threads never share a worker index
+size_t first_call_index() {
+  static std::atomic<size_t> next_index{0};
+  static thread_local const size_t index = next_index++;
+  return index;
+}
+
+/// Threads should use the interfaces of their own partition until all of
+/// them reach the steal limit
+void test_thread_affinity() {
+  // 4 partitions with 2 interfaces each, steal at load 2
+  thread_affine_pool_config config;
+  config.steal_load_limit = 2;
+  config.number_partitions = 4;
+  config.number_workers = 4;
+  config.worker_index = first_call_index;
+  thread_affine_pool<dummy_interface> pool(8, config);
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < 4; i++) {
+    indices.push_back(std::get<1>(pool.get_interface()));
+  }
+  const size_t own_partition = indices[0] / 2;
+  for (auto index : indices) {
+    assert(index / 2 == own_partition); // stays within the own partition
+  }
+  // all own interfaces are at the steal limit -> use another partition
+  indices.push_back(std::get<1>(pool.get_interface()));
+  assert(indices.back() / 2 != own_partition);
+  // another thread uses a different partition
+  std::thread other_thread([&pool, own_partition]() {
+    auto other_index = std::get<1>(pool.get_interface());
+    assert(other_index / 2 != own_partition);
+    pool.release_interface(other_index);
+  });
+  other_thread.join();
+  for (auto index : indices) {
+    pool.release_interface(index);
+  }
+  assert(pool.get_current_load() == 0);
+}
+
+/// Heavy work should not be piled onto one stream: the load of an interface
+/// is the sum of the weights of its acquisitions
+template <typename Pool, typename... Ts>
+void test_weighted_load(const std::string &pool_name, Ts &&... ts) {
+  stream_pool::init<dummy_interface, Pool>(2, std::forward<Ts>(ts)...);
+  {
+    stream_interface<dummy_interface, Pool> heavy(50);
+    std::vector<size_t> light_indices;
+    for (size_t i = 0; i < 3; i++) {
+      light_indices.push_back(
+          std::get<1>(stream_pool::get_interface<dummy_interface, Pool>()));
+    }
+    // all light tasks avoid the heavily loaded stream
+    assert(light_indices[0] == light_indices[1]);
+    assert(light_indices[1] == light_indices[2]);
+    auto load = stream_pool::get_current_load<dummy_interface, Pool>();
+    assert(load == 3);
+    bool available =
+        stream_pool::interface_available<dummy_interface, Pool>(4);
+    assert(available);
+    for (auto index : light_indices) {
+      stream_pool::release_interface<dummy_interface, Pool>(index);
+    }
+    load = stream_pool::get_current_load<dummy_interface, Pool>();
+    assert(load == 0);
+  }
+  // the heavy interface was released with its weight
+  const auto heavy = stream_pool::get_interface<dummy_interface, Pool>(7);
+  const auto other = stream_pool::get_interface<dummy_interface, Pool>(5);
+  assert(std::get<1>(heavy) != std::get<1>(other));
+  auto load = stream_pool::get_current_load<dummy_interface, Pool>();
+  assert(load == 5);
+  stream_pool::release_interface<dummy_interface, Pool>(std::get<1>(heavy), 7);
+  stream_pool::release_interface<dummy_interface, Pool>(std::get<1>(other), 5);
+  load = stream_pool::get_current_load<dummy_interface, Pool>();
+  assert(load == 0);
+  stream_pool::cleanup<dummy_interface, Pool>();
+  std::cout << "==> " << pool_name << " weighted load test passed"
+            << std::endl;
+}
+
+/// The adaptive pool should create interfaces while all of them are loaded
+/// and retire them again once they are idle
+void test_adaptive_pool() {
+  using pool_type = adaptive_pool<dummy_interface>;
+  adaptive_pool_config config;
+  config.min_streams = 1;
+  config.max_streams = 4;
+  config.grow_load_threshold = 2;
+  config.grow_window = 4;
+  config.shrink_window = 8;
+  stream_pool::init<dummy_interface, pool_type>(1, config);
+
+  // Keep many tasks in flight -> grows up to max_streams
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < 64; i++) {
+    indices.push_back(
+        std::get<1>(stream_pool::get_interface<dummy_interface, pool_type>()));
+  }
+  auto statistics = stream_pool::get_statistics<dummy_interface, pool_type>();
+  assert(statistics.number_streams == 4);
+  assert(statistics.peak_number_streams == 4);
+  assert(statistics.grow_events == 3);
+  assert(statistics.shrink_events == 0);
+  for (auto index : indices) {
+    assert(index < 4);
+    stream_pool::release_interface<dummy_interface, pool_type>(index);
+  }
+
+  // Only one task in flight -> shrinks back to min_streams
+  for (size_t i = 0; i < 64; i++) {
+    auto index =
+        std::get<1>(stream_pool::get_interface<dummy_interface, pool_type>());
+    stream_pool::release_interface<dummy_interface, pool_type>(index);
+  }
+  statistics = stream_pool::get_statistics<dummy_interface, pool_type>();
+  assert(statistics.number_streams == 1);
+  assert(statistics.peak_number_streams == 4);
+  assert(statistics.shrink_events == 3);
+  assert(statistics.acquisitions == 128);
+  auto load = stream_pool::get_current_load<dummy_interface, pool_type>();
+  assert(load == 0);
+  stream_pool::cleanup<dummy_interface, pool_type>();
+  std::cout << "==> adaptive_pool grew to " << statistics.peak_number_streams
+            << " and shrank back to " << statistics.number_streams
+            << " interfaces" << std::endl;
+}
+
+/// Work of the busy_interfaces - only finishes once the test says so
+std::promise<void> busy_work;
+std::shared_future<void> busy_work_done = busy_work.get_future().share();
+size_t number_destroyed_busy_interfaces = 0;
+/// Interface that still has work in flight after its release
+class busy_interface {
+public:
+  busy_interface() = default;
+  busy_interface(const busy_interface &other) = delete;
+  busy_interface &operator=(const busy_interface &other) = delete;
+  busy_interface(busy_interface &&other) = delete;
+  busy_interface &operator=(busy_interface &&other) = delete;
+  ~busy_interface() { number_destroyed_busy_interfaces++; }
+  std::shared_future<void> get_future() const { return busy_work_done; }
+};
+
+/// Idle interfaces with work in flight should only be destroyed once their
+/// work is done
+void test_adaptive_pool_retirement() {
+  adaptive_pool_config config;
+  config.min_streams = 1;
+  config.max_streams = 2;
+  config.shrink_window = 2;
+  adaptive_pool<busy_interface> pool(2, config);
+  for (size_t i = 0; i < 2; i++) {
+    pool.release_interface(std::get<1>(pool.get_interface()));
+  }
+  auto statistics = pool.get_statistics();
+  assert(statistics.shrink_events == 1);
+  assert(statistics.number_streams == 1);
+  assert(statistics.retiring_streams == 1);
+  assert(number_destroyed_busy_interfaces == 0);
+  // Work done -> the next acquisition destroys the retired interface
+  busy_work.set_value();
+  pool.release_interface(std::get<1>(pool.get_interface()));
+  statistics = pool.get_statistics();
+  assert(statistics.retiring_streams == 0);
+  assert(number_destroyed_busy_interfaces == 1);
+  std::cout << "==> adaptive_pool waited for the work of retired interfaces"
+            << std::endl;
+}
+
+/// Requests for interfaces below a load limit should wait in FIFO order
+/// until a release makes an interface available
+template <typename Pool, typename... Ts>
+void test_waiting_requests(const std::string &pool_name,
+                           const size_t number_threads, const size_t passes,
+                           Ts &&... ts) {
+  stream_pool::init<dummy_interface, Pool>(2, std::forward<Ts>(ts)...);
+  const auto first = stream_pool::get_interface<dummy_interface, Pool>();
+  const auto second = stream_pool::get_interface<dummy_interface, Pool>();
+  std::vector<size_t> served_indices;
+  auto request = [&served_indices](dummy_interface & /*unused*/,
+                                   size_t index) {
+    served_indices.push_back(index);
+  };
+  stream_pool::get_interface_when_available<dummy_interface, Pool>(1, request);
+  stream_pool::get_interface_when_available<dummy_interface, Pool>(1, request);
+  size_t waiting =
+      stream_pool::get_number_waiting_requests<dummy_interface, Pool>();
+  assert(waiting == 2);
+  assert(served_indices.empty());
+  stream_pool::release_interface<dummy_interface, Pool>(std::get<1>(second));
+  assert(served_indices.size() == 1);
+  assert(served_indices[0] == std::get<1>(second));
+  stream_pool::release_interface<dummy_interface, Pool>(std::get<1>(first));
+  assert(served_indices.size() == 2);
+  assert(served_indices[1] == std::get<1>(first));
+  waiting = stream_pool::get_number_waiting_requests<dummy_interface, Pool>();
+  assert(waiting == 0);
+  for (auto index : served_indices) {
+    stream_pool::release_interface<dummy_interface, Pool>(index);
+  }
+
+  // A throwing callback must not escape the (noexcept) release - its
+  // interface gets released again and the next request is still served
+  const auto busy = stream_pool::get_interface<dummy_interface, Pool>();
+  const auto busy2 = stream_pool::get_interface<dummy_interface, Pool>();
+  stream_pool::get_interface_when_available<dummy_interface, Pool>(
+      1, [](dummy_interface & /*unused*/, size_t /*unused*/) {
+        throw std::runtime_error("callback failed");
+      });
+  served_indices.clear();
+  stream_pool::get_interface_when_available<dummy_interface, Pool>(1, request);
+  stream_pool::release_interface<dummy_interface, Pool>(std::get<1>(busy));
+  assert(served_indices.size() == 1);
+  stream_pool::release_interface<dummy_interface, Pool>(served_indices[0]);
+  stream_pool::release_interface<dummy_interface, Pool>(std::get<1>(busy2));
+  assert((stream_pool::get_current_load<dummy_interface, Pool>() == 0));
+
+  // Concurrent producers throttled by the load limit: no request may get
+  // lost
+  std::atomic<size_t> number_served{0};
+  std::vector<std::thread> threads;
+  for (size_t thread_id = 0; thread_id < number_threads; thread_id++) {
+    threads.emplace_back([passes, &number_served]() {
+      for (size_t pass = 0; pass < passes; pass++) {
+        stream_pool::get_interface_when_available<dummy_interface, Pool>(
+            1, [&number_served](dummy_interface & /*unused*/, size_t index) {
+              number_served++;
+              stream_pool::release_interface<dummy_interface, Pool>(index);
+            });
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  assert(number_served == number_threads * passes);
+  auto load = stream_pool::get_current_load<dummy_interface, Pool>();
+  assert(load == 0);
+  stream_pool::cleanup<dummy_interface, Pool>();
+  std::cout << "==> " << pool_name << " served " << number_served
+            << " waiting requests" << std::endl;
+}
+
+/// Pools of the same type with different tags have to be independent
+void test_named_pools() {
+  struct hydro_tag {};
+  struct gravity_tag {};
+  using hydro_pool = named_pool<priority_pool<dummy_interface>, hydro_tag>;
+  using gravity_pool = named_pool<priority_pool<dummy_interface>, gravity_tag>;
+  stream_pool::init<dummy_interface, hydro_pool>(1);
+  stream_pool::init<dummy_interface, gravity_pool>(2);
+  {
+    stream_interface<dummy_interface, hydro_pool> hydro1;
+    stream_interface<dummy_interface, hydro_pool> hydro2;
+    auto hydro_load =
+        stream_pool::get_current_load<dummy_interface, hydro_pool>();
+    auto gravity_load =
+        stream_pool::get_current_load<dummy_interface, gravity_pool>();
+    assert(hydro_load == 2);
+    assert(gravity_load == 0);
+    stream_interface<dummy_interface, gravity_pool> gravity1;
+    stream_interface<dummy_interface, gravity_pool> gravity2;
+    gravity_load =
+        stream_pool::get_current_load<dummy_interface, gravity_pool>();
+    assert(gravity_load == 1);
+    // different interfaces
+    assert(&hydro1.interface != &gravity1.interface);
+    assert(&hydro1.interface != &gravity2.interface);
+  }
+  stream_pool::cleanup<dummy_interface, hydro_pool>();
+  auto gravity_load =
+      stream_pool::get_current_load<dummy_interface, gravity_pool>();
+  assert(gravity_load == 0); // still usable
+  stream_pool::cleanup<dummy_interface, gravity_pool>();
+}
+
+int main(int argc, char *argv[]) {
+
+  size_t number_threads = 8;
+  size_t passes = 100000;
+  size_t number_streams = 8;
+  std::string filename{};
+
+  try {
+    boost::program_options::options_description desc{"Options"};
+    desc.add_options()("help", "Help screen")(
+        "threads",
+        boost::program_options::value<size_t>(&number_threads)
+            ->default_value(8),
+        "Number of threads accessing the pools concurrently")(
+        "streams",
+        boost::program_options::value<size_t>(&number_streams)
+            ->default_value(8),
+        "Number of interfaces per pool")(
+        "passes",
+        boost::program_options::value<size_t>(&passes)->default_value(100000),
+        "Sets the number of get/release pairs per thread")(
+        "outputfile",
+        boost::program_options::value<std::string>(&filename)->default_value(
+            ""),
+        "Redirect stdout/stderr to this file");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::parsed_options options =
+        parse_command_line(argc, argv, desc);
+    boost::program_options::store(options, vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") == 0u) {
+      std::cout << "Running with parameters:" << std::endl
+                << " --threads = " << number_threads << std::endl
+                << " --streams = " << number_streams << std::endl
+                << " --passes = " << passes << std::endl;
+    } else {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+  } catch (const boost::program_options::error &ex) {
+    std::cerr << "CLI argument problem found: " << ex.what() << '\n';
+  }
+  if (!filename.empty()) {
+    freopen(filename.c_str(), "w", stdout); // NOLINT
+    freopen(filename.c_str(), "w", stderr); // NOLINT
+  }
+
+  assert(passes >= 1);         // NOLINT
+  assert(number_threads >= 1); // NOLINT
+  assert(number_streams >= 1); // NOLINT
+
+  static_assert(
+      recycler::detail::is_thread_safe_pool<
+          round_robin_pool<dummy_interface>>::value,
+      "round_robin_pool should be lock-free");
+  static_assert(
+      recycler::detail::is_thread_safe_pool<
+          thread_affine_pool<dummy_interface>>::value,
+      "thread_affine_pool should be lock-free");
+  static_assert(
+      recycler::detail::is_thread_safe_pool<named_pool<
+          round_robin_pool<dummy_interface>, struct tag>>::value,
+      "named pools should keep the thread-safety of their pool");
+  static_assert(!recycler::detail::is_thread_safe_pool<
+                    priority_pool<dummy_interface>>::value,
+                "priority_pool should be locked");
+
+  const size_t lock_free_duration =
+      test_pool_concurrency<round_robin_pool<dummy_interface>>(
+          "round_robin_pool", number_threads, passes, number_streams,
+          number_streams);
+  const size_t locked_duration =
+      test_pool_concurrency<priority_pool<dummy_interface>>(
+          "priority_pool", number_threads, passes, number_streams,
+          number_streams);
+  test_pool_concurrency<thread_affine_pool<dummy_interface>>(
+      "thread_affine_pool", number_threads, passes, number_streams,
+      number_streams);
+  test_thread_affinity();
+  test_weighted_load<priority_pool<dummy_interface>>("priority_pool");
+  thread_affine_pool_config single_partition;
+  single_partition.number_partitions = 1;
+  test_weighted_load<thread_affine_pool<dummy_interface>>("thread_affine_pool",
+                                                          single_partition);
+  test_adaptive_pool();
+  test_adaptive_pool_retirement();
+  test_named_pools();
+  test_waiting_requests<priority_pool<dummy_interface>>(
+      "priority_pool", number_threads, passes / 10);
+  thread_affine_pool_config steal_early;
+  steal_early.steal_load_limit = 1;
+  test_waiting_requests<thread_affine_pool<dummy_interface>>(
+      "thread_affine_pool", number_threads, passes / 10, steal_early);
+  // The check for one reference per interface afterwards requires a fixed
+  // size: At most number_threads tasks are in flight, so this never grows
+  adaptive_pool_config config;
+  config.min_streams = number_streams;
+  config.max_streams = 2 * number_streams;
+  config.grow_load_threshold = number_threads + 1;
+  test_pool_concurrency<adaptive_pool<dummy_interface>>(
+      "adaptive_pool", number_threads, passes, number_streams,
+      number_streams, config);
+  test_pool_concurrency<multi_gpu_round_robin_pool<
+      dummy_interface, round_robin_pool<dummy_interface>>>(
+      "multi_gpu_round_robin_pool", number_threads, passes, number_streams,
+      2 * number_streams, 2);
+  test_pool_concurrency<priority_pool_multi_gpu<
+      dummy_interface, priority_pool<dummy_interface>>>(
+      "priority_pool_multi_gpu", number_threads, passes, number_streams,
+      2 * number_streams, 2);
+
+  if (lock_free_duration < locked_duration) {
+    std::cout << "Test information: Lock-free pool was faster than locked "
+                 "pool!"
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
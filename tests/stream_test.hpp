@@ -6,6 +6,7 @@
 #ifndef STREAM_TEST_HPP // NOLINT
 #define STREAM_TEST_HPP // NOLINT
 #include "../include/buffer_manager.hpp"
+#ifdef CPPUDDLE_HAVE_CUDA
 #include "../include/cuda_buffer_util.hpp"
 
 template <typename Interface, typename Pool, typename... Ts>
@@ -43,6 +44,7 @@ void test_pool_memcpy(const size_t stream_parameter, Ts &&... ts) {
   }
   stream_pool::cleanup<Interface, Pool>();
 }
+#endif
 
 template <typename Interface, typename Pool, typename... Ts>
 void test_pool_ref_counting(const size_t stream_parameter, Ts &&... ts) {